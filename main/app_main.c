@@ -40,10 +40,13 @@
 #include "factoryreset.h"
 #include "statistics/statistics.h"
 #include "rgb7seg.h"
+#include "ds18b20.h"
 
-#define TEMP_BUS 17
+#define TEMP_BUS CONFIG_TEMP_BUS_GPIO
 #define STATISTICS_INTERVAL 1800
 #define CLOCK_INTERVAL 10
+#define DEFAULT_TRANSITION_MS 400
+#define DEFAULT_SCROLL_MS 300
 #define ESP_INTR_FLAG_DEFAULT 0
 
 
@@ -87,31 +90,63 @@ struct config {
     int showinternaltemp;
     int zonelow;
     int zonehigh;
+    int brightness;
+    int deadband;   // 1/100 degrees, smaller temperature changes are not published
+    int heartbeat;  // seconds, an unchanged temperature is published this often
 };
 
 struct config setup = { .showinternaltemp = 1,
                          .zonelow = 2300,
-                         .zonehigh = 2600};
+                         .zonehigh = 2600,
+                         .brightness = RGB7SEG_DEFAULT_BRIGHTNESS,
+                         .deadband = 10,
+                         .heartbeat = 600};
+
+// last published temperature of each sensor, indexed like temperature_getsensor()
+struct published {
+    bool valid;
+    int err;
+    float temperature;
+    time_t ts;
+};
+static struct published lastpublished[DS18B20_ROSTER_MAX];
+static uint32_t publishsuppressed = 0;
+
+// display geometry, changes take effect after restart
+struct rgb7seg_layout layout;
 
+// Colors are gamma encoded. At the default brightness the leds get the
+// same linear values as before gamma correction, 255 is the old 50.
 struct colorname {
     char *name;
     struct color c;
 } colornames[] =
 {
-    {"red",   {50,  0,  0}},
-    {"green", { 0, 50,  0}},
-    {"blue",  { 0,  0, 50}},
-    {"cyan",  { 0, 50, 50}},
-    {"purple",{50,  0, 50}},
-    {"yellow",{50, 50,  0}},
-    {"white", {50, 50, 50}},
-    {"pink",  {50,  5, 20}},
-    {"gold",  {50, 42,  0}},
-    {"orange",{50, 32,  0}},
-    {"tomato",{50, 19, 14}},
-    {"sky",   { 0, 37, 50}},
-    {"aqua",  {25, 50, 41}},
-    {"\0",    {50,  0,  0}}
+    {"red",   {255,   0,   0}},
+    {"green", {  0, 255,   0}},
+    {"blue",  {  0,   0, 255}},
+    {"cyan",  {  0, 255, 255}},
+    {"purple",{255,   0, 255}},
+    {"yellow",{255, 255,   0}},
+    {"white", {255, 255, 255}},
+    {"pink",  {255,  90, 168}},
+    {"gold",  {255, 236,   0}},
+    {"orange",{255, 208,   0}},
+    {"tomato",{255, 164, 143}},
+    {"sky",   {  0, 222, 255}},
+    {"aqua",  {186, 255, 233}},
+    {"\0",    {255,   0,   0}}
+};
+
+struct transitionname {
+    char *name;
+    enum rgb7seg_transition transition;
+} transitionnames[] =
+{
+    {"fade",  RGB7SEG_FADE},
+    {"slide", RGB7SEG_SLIDE},
+    {"pulse", RGB7SEG_PULSE},
+    {"\0",    RGB7SEG_NONE}
 };
 // globals
 
@@ -135,10 +170,14 @@ static char appname[20];
 static struct colorname *default_color = &colornames[1];
 static struct colorname *low_color = &colornames[2];
 static struct colorname *high_color = &colornames[0];
+static struct colorname *colon_color = NULL; // NULL: same color as digits
 nvs_handle setup_flash;
 
 static void sendSetup(esp_mqtt_client_handle_t client, uint8_t *chipid, uint8_t flags);
 static void sendInfo(esp_mqtt_client_handle_t client, uint8_t *chipid);
+static void sendDisplayStatistics(esp_mqtt_client_handle_t client, uint8_t *chipid);
+static void sendSensorResolutions(esp_mqtt_client_handle_t client, uint8_t *chipid);
+static void sendSensorStatistics(esp_mqtt_client_handle_t client, uint8_t *chipid);
 
 
 static char *getJsonStr(cJSON *js, char *name)
@@ -217,25 +256,25 @@ static void show_internaltemp(float value)
 
     if (value != 8888)
     {
-        dispvar = value * 100; // we dont have decimal point in display.
+        dispvar = value * 100; // zone limits are in 1/100 degrees
     }
 
     if (dispvar < setup.zonelow) dispcolor = low_color;
     else if (dispvar > setup.zonehigh) dispcolor = high_color;
     else dispcolor = default_color;
 
-    char buff[6];
-    sprintf(buff,"%4d", dispvar);
-    rgb7seg_display(buff,dispcolor->c);
+    char buff[10];
+    sprintf(buff,"%5.1f", dispvar / 100.0);
+    rgb7seg_display(0, buff, dispcolor->c, RGB7SEG_SRC_MAIN);
 }
 
 static void show_clock(time_t now)
 {
     struct tm *current_time = localtime(&now);
-    char buff[6];
+    char buff[8];
 
-    sprintf(buff,"%02d%02d", current_time->tm_hour, current_time->tm_min);
-    rgb7seg_display(buff,default_color->c);
+    sprintf(buff,"%02d:%02d", current_time->tm_hour, current_time->tm_min);
+    rgb7seg_display(0, buff, default_color->c, RGB7SEG_SRC_MAIN);
 }
 
 
@@ -268,6 +307,36 @@ static struct colorname *get_color(char *name)
     return NULL;
 }
 
+// reads an array of color names, unknown names get the default color.
+static int getJsonColors(cJSON *js, char *name, struct color *colors, int maxcolors)
+{
+    int cnt = 0;
+    cJSON *item;
+    cJSON *array = cJSON_GetObjectItem(js, name);
+
+    if (array == NULL || !cJSON_IsArray(array))
+        return 0;
+
+    cJSON_ArrayForEach(item, array)
+    {
+        if (cnt == maxcolors) break;
+        struct colorname *c = cJSON_IsString(item) ? get_color(item->valuestring) : NULL;
+        colors[cnt++] = (c != NULL) ? c->c : default_color->c;
+    }
+    return cnt;
+}
+
+static enum rgb7seg_transition get_transition(char *name)
+{
+    int i=0;
+    for (; transitionnames[i].name[0] != 0;i++)
+    {
+        if (!strcmp(transitionnames[i].name, name))
+            break;
+    }
+    return transitionnames[i].transition;
+}
+
 static void readSetupJson(cJSON *root)
 {
     bool redisp_needed = false;
@@ -307,18 +376,67 @@ static void readSetupJson(cJSON *root)
         redisp_needed = true;
     }
 
+    // "" or "none" lets the colon follow the digit color again
+    if (cJSON_GetObjectItem(root, "coloncolor") != NULL)
+    {
+        cname = getJsonStr(root,"coloncolor");
+        c = get_color(cname);
+        if (c != NULL || cname[0] == 0 || !strcmp(cname, "none"))
+        {
+            colon_color = c;
+            rgb7seg_set_indicator(RGB7SEG_COLON, colon_color ? &colon_color->c : NULL, true);
+            flash_write_str(setup_flash, "coloncolor", colon_color ? cname : "");
+            redisp_needed = true;
+        }
+    }
+
     if (getJsonInt(root, "zonelow", &setup.zonelow))
     {
         flash_write(setup_flash, "zonelow", setup.zonelow);
+        ds18b20_setPrecisionZone(setup.zonelow, setup.zonehigh);
         redisp_needed = true;
     }
 
     if (getJsonInt(root, "zonehigh", &setup.zonehigh))
     {
         flash_write(setup_flash, "zonehigh", setup.zonehigh);
+        ds18b20_setPrecisionZone(setup.zonelow, setup.zonehigh);
         redisp_needed = true;
     }
 
+    if (getJsonInt(root, "brightness", &setup.brightness))
+    {
+        if (setup.brightness < 0) setup.brightness = 0;
+        if (setup.brightness > 255) setup.brightness = 255;
+        flash_write(setup_flash, "brightness", setup.brightness);
+        rgb7seg_set_brightness(setup.brightness);
+        redisp_needed = true;
+    }
+
+    int val = layout.digits;
+    if (getJsonInt(root, "digits", &val) && val > 0 && val <= RGB7SEG_MAX_DIGITS)
+    {
+        layout.digits = val;
+        flash_write(setup_flash, "digits", layout.digits);
+        ESP_LOGI(TAG, "display digits changed, restart needed.");
+    }
+
+    val = layout.segleds;
+    if (getJsonInt(root, "segleds", &val) && val > 0 && val <= RGB7SEG_MAX_SEGLEDS)
+    {
+        layout.segleds = val;
+        flash_write(setup_flash, "segleds", layout.segleds);
+        ESP_LOGI(TAG, "leds per segment changed, restart needed.");
+    }
+
+    cname = getJsonStr(root, "segorder");
+    if (strlen(cname) == 7)
+    {
+        strcpy(layout.order, cname);
+        flash_write_str(setup_flash, "segorder", layout.order);
+        ESP_LOGI(TAG, "segment order changed, restart needed.");
+    }
+
     if (redisp_needed)
     {
         ESP_LOGI(TAG,"doing some reinit stuff.");
@@ -357,22 +475,60 @@ static uint8_t handleJson(esp_mqtt_event_handle_t event, uint8_t *chipid)
     else if (!strcmp(id,"show"))
     {
         char *data = getJsonStr(root,"data");
-
-        char *name = getJsonStr(root,"color");
-        if (name[0] != 0)
+        struct colorname *c = get_color(getJsonStr(root,"color"));
+        enum rgb7seg_transition transition = get_transition(getJsonStr(root,"transition"));
+        int ms = DEFAULT_TRANSITION_MS;
+        int scroll = DEFAULT_SCROLL_MS;
+        int repeat = 1;
+        int panel = 0;
+
+        if (c == NULL)
+        {
+            c = default_color;
+        }
+        struct color colors[RGB7SEG_MAX_DIGITS];
+        int ncolors;
+
+        getJsonInt(root, "ms", &ms);
+        getJsonInt(root, "scroll", &scroll);
+        getJsonInt(root, "repeat", &repeat);
+        getJsonInt(root, "panel", &panel);
+        if ((ncolors = getJsonColors(root, "colors", colors, rgb7seg_digits())) <= 0 &&
+            getJsonColors(root, "gradient", colors, 2) == 2)
+        {
+            ncolors = rgb7seg_gradient(colors[0], colors[1], colors);
+        }
+        // text which does not fit scrolls, also with colors
+        if (rgb7seg_text_digits(data) > rgb7seg_digits())
         {
-            struct colorname *c = get_color(getJsonStr(root,"color"));
-            rgb7seg_display(data,c->c);
+            if (ncolors > 0)
+                rgb7seg_marquee_colors(panel, data, colors, ncolors, RGB7SEG_SRC_MQTT, scroll, repeat);
+            else
+                rgb7seg_marquee(panel, data, c->c, RGB7SEG_SRC_MQTT, scroll, repeat);
+        }
+        else if (ncolors > 0)
+        {
+            rgb7seg_display_colors(panel, data, colors, ncolors, RGB7SEG_SRC_MQTT);
         }
         else
         {
-            rgb7seg_display(data,default_color->c);
+            rgb7seg_animate(panel, data, c->c, RGB7SEG_SRC_MQTT, transition, ms);
         }
     }
     else if (!strcmp(id,"sensorsetup"))
     {
         strncpy(setup.specialsensor,getJsonStr(root,"specialsensor"),20);
         flash_write_str(setup_flash, "specsensor", setup.specialsensor);
+        if (getJsonInt(root, "deadband", &setup.deadband))
+        {
+            if (setup.deadband < 0) setup.deadband = 0;
+            flash_write(setup_flash, "deadband", setup.deadband);
+        }
+        if (getJsonInt(root, "heartbeat", &setup.heartbeat))
+        {
+            if (setup.heartbeat < 0) setup.heartbeat = 0;
+            flash_write(setup_flash, "heartbeat", setup.heartbeat);
+        }
         ret |= SETUP_SENSORS;
     }
     else if (!strcmp(id,"sensorfriendlyname"))
@@ -418,7 +574,7 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         ESP_LOGI(TAG, "sent subscribe %s successful, msg_id=%d", dataTopic, msg_id);
 
         gpio_set_level(MQTTSTATUS_GPIO, true);
-        rgb7seg_display("mqtt",default_color->c);
+        rgb7seg_display(0, "mqtt",default_color->c, RGB7SEG_SRC_MQTT);
         device_sendstatus(client, comminfo->mqtt_prefix, appname, (uint8_t *) handler_args);
         isConnected = true;
         statistics_getptr()->connectcnt++;
@@ -509,23 +665,133 @@ int getWifiStrength(void)
 
 static void sendInfo(esp_mqtt_client_handle_t client, uint8_t *chipid)
 {
+    const struct ds18b20_slots *slots = ds18b20_getSlots();
+
     gpio_set_level(BLINK_GPIO, true);
 
     char infoTopic[42];
 
     sprintf(infoTopic,"%s/%s/%x%x%x/info",
          comminfo->mqtt_prefix, appname, chipid[3],chipid[4],chipid[5]);
-    sprintf(jsondata, "{\"dev\":\"%x%x%x\",\"id\":\"info\",\"memfree\":%d,\"idfversion\":\"%s\",\"progversion\":\"%s\"}",
+    sprintf(jsondata, "{\"dev\":\"%x%x%x\",\"id\":\"info\",\"memfree\":%d,\"idfversion\":\"%s\",\"progversion\":\"%s\",\"onewirecritus\":%lu,\"onewireresets\":%lu,\"onewireslots\":%lu}",
                 chipid[3],chipid[4],chipid[5],
                 esp_get_free_heap_size(),
                 esp_get_idf_version(),
-                program_version);
+                program_version,
+                ds18b20_criticalTime(),
+                slots->resets,
+                slots->writes + slots->reads);
     esp_mqtt_client_publish(client, infoTopic, jsondata , 0, 0, 1);
     statistics_getptr()->sendcnt++;
     gpio_set_level(BLINK_GPIO, false);
 }
 
 
+static void sendDisplayStatistics(esp_mqtt_client_handle_t client, uint8_t *chipid)
+{
+    static const char *sourcenames[RGB7SEG_SRC_CNT] = {"main", "mqtt", "wifi"};
+    struct rgb7seg_stats *dstats = rgb7seg_getstats();
+    size_t len;
+    int n;
+
+    // latencies which do not fit are left out
+    len = snprintf(jsondata, sizeof(jsondata), "{\"dev\":\"%x%x%x\",\"id\":\"displaystatistics\",\"framessent\":%lu,\"framesskipped\":%lu,\"animframes\":%lu,\"animdropped\":%lu,\"cachehits\":%lu,\"cachemisses\":%lu,\"refreshes\":%lu,\"refreshlate\":%lu,\"dithercpu\":%lu,\"currentma\":%lu,\"limited\":%lu,\"latency\":[",
+                chipid[3],chipid[4],chipid[5],
+                dstats->sent,
+                dstats->skipped,
+                dstats->animframes,
+                dstats->animdropped,
+                dstats->cachehits,
+                dstats->cachemisses,
+                dstats->refreshes,
+                dstats->refreshlate,
+                dstats->dithercpu,
+                dstats->currentma,
+                dstats->limited);
+
+    for (int i = 0; i < RGB7SEG_SRC_CNT; i++)
+    {
+        struct rgb7seg_latency *lat = &dstats->latency[i];
+        uint32_t avg = lat->count ? lat->total_us / lat->count : 0;
+
+        n = snprintf(&jsondata[len], sizeof(jsondata) - len, "{\"source\":\"%s\",\"count\":%lu,\"avgus\":%lu,\"maxus\":%lu},",
+            sourcenames[i], lat->count, avg, lat->max_us);
+        if (len + n + 3 > sizeof(jsondata))
+            break;
+        len += n;
+    }
+    if (jsondata[len-1] == ',')
+        len--; // cut last comma
+    snprintf(&jsondata[len], sizeof(jsondata) - len, "]}");
+    esp_mqtt_client_publish(client, statisticsTopic, jsondata , 0, 0, 1);
+    statistics_getptr()->sendcnt++;
+}
+
+
+// A temperature is published when it has moved more than the deadband from
+// the last published one, when its error state changes, or when the heartbeat
+// interval has passed. Heartbeat 0 publishes only the changes.
+static bool publishDue(struct measurement *meas, time_t now)
+{
+    struct published *p;
+
+    if (meas->gpio < 0 || meas->gpio >= DS18B20_ROSTER_MAX)
+        return true;
+    p = &lastpublished[meas->gpio];
+    if (p->valid && p->err == meas->err &&
+        fabsf(meas->data.temperature - p->temperature) * 100 < setup.deadband &&
+        (setup.heartbeat == 0 || now - p->ts < setup.heartbeat))
+    {
+        publishsuppressed++;
+        return false;
+    }
+    p->valid = true;
+    p->err = meas->err;
+    p->temperature = meas->data.temperature;
+    p->ts = now;
+    return true;
+}
+
+
+// temperatures left unpublished by publishDue()
+static void sendSensorStatistics(esp_mqtt_client_handle_t client, uint8_t *chipid)
+{
+    sprintf(jsondata, "{\"dev\":\"%x%x%x\",\"id\":\"sensorstatistics\",\"publishsuppressed\":%lu}",
+                chipid[3],chipid[4],chipid[5],
+                publishsuppressed);
+    esp_mqtt_client_publish(client, statisticsTopic, jsondata , 0, 0, 1);
+    statistics_getptr()->sendcnt++;
+}
+
+
+// resolution each sensor converts at, chosen by the ds18b20 driver
+static void sendSensorResolutions(esp_mqtt_client_handle_t client, uint8_t *chipid)
+{
+    const DeviceAddress *addr;
+    char sensor[48];
+
+    sprintf(jsondata, "{\"dev\":\"%x%x%x\",\"id\":\"sensorresolution\",\"conversionms\":%d,\"sensors\":[",
+                chipid[3],chipid[4],chipid[5],
+                millisToWaitForConversion());
+
+    for (int i = 0; (addr = ds18b20_getPolicySensor(i)) != NULL; i++)
+    {
+        const uint8_t *a = *addr;
+
+        sprintf(sensor,"{\"sensor\":\"%02x%02x%02x%02x%02x%02x%02x%02x\",\"bits\":%d},",
+            a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], ds18b20_getSensorResolution(addr));
+        if (strlen(jsondata) + strlen(sensor) + 3 > sizeof(jsondata))
+            break;
+        strcat(jsondata,sensor);
+    }
+    if (jsondata[strlen(jsondata)-1] == ',')
+        jsondata[strlen(jsondata)-1] = 0; // cut last comma
+    strcat(jsondata,"]}");
+    esp_mqtt_client_publish(client, statisticsTopic, jsondata , 0, 0, 1);
+    statistics_getptr()->sendcnt++;
+}
+
+
 /* ../setsetup -m '{"temperature": 8, "hysteresis": 2, "mintimeon": 120, "lopriceboost": 2, "hipricereduce", 1}'
 */
 
@@ -546,9 +812,8 @@ static void sendSetup(esp_mqtt_client_handle_t client, uint8_t *chipid, uint8_t
 
         for (int i=0; colornames[i].name[0]!=0; i++)
         {
-            // multiply colorvalues, otherwise they are not visible enough in web browser.
             sprintf(colorvalue,"{\"name\":\"%s\",\"value\":\"#%02x%02x%02x\"},",
-                colornames[i].name, 3 * colornames[i].c.r, 3* colornames[i].c.g, 3 * colornames[i].c.b);
+                colornames[i].name, colornames[i].c.r, colornames[i].c.g, colornames[i].c.b);
             strcat(jsondata,colorvalue);
         }
         jsondata[strlen(jsondata)-1] = 0; // cut last comma
@@ -562,14 +827,19 @@ static void sendSetup(esp_mqtt_client_handle_t client, uint8_t *chipid, uint8_t
     {
         sprintf(setupTopic,"%s/%s/%x%x%x/setup",
             comminfo->mqtt_prefix, appname, chipid[3],chipid[4],chipid[5]);
-        sprintf(jsondata, "{\"dev\":\"%x%x%x\",\"id\":\"setup\",\"defaultcolor\":\"%s\",\"lowcolor\":\"%s\",\"highcolor\":\"%s\",\"zonelow\":\"%d\",\"zonehigh\":\"%d\",\"showinternaltemp\":%d}",
+        sprintf(jsondata, "{\"dev\":\"%x%x%x\",\"id\":\"setup\",\"defaultcolor\":\"%s\",\"lowcolor\":\"%s\",\"highcolor\":\"%s\",\"coloncolor\":\"%s\",\"zonelow\":\"%d\",\"zonehigh\":\"%d\",\"showinternaltemp\":%d,\"brightness\":%d,\"digits\":%d,\"segleds\":%d,\"segorder\":\"%s\"}",
                     chipid[3],chipid[4],chipid[5],
                     default_color->name,
                     low_color->name,
                     high_color->name,
+                    colon_color ? colon_color->name : "",
                     setup.zonelow,
                     setup.zonehigh,
-                    setup.showinternaltemp);
+                    setup.showinternaltemp,
+                    setup.brightness,
+                    layout.digits,
+                    layout.segleds,
+                    layout.order);
         esp_mqtt_client_publish(client, setupTopic, jsondata , 0, 0, 1);
         statistics_getptr()->sendcnt++;
         vTaskDelay(10 / portTICK_PERIOD_MS);
@@ -579,9 +849,11 @@ static void sendSetup(esp_mqtt_client_handle_t client, uint8_t *chipid, uint8_t
     {
         sprintf(setupTopic,"%s/%s/%x%x%x/sensorsetup",
             comminfo->mqtt_prefix, appname, chipid[3],chipid[4],chipid[5]);
-        sprintf(jsondata, "{\"dev\":\"%x%x%x\",\"id\":\"sensorsetup\",\"specialsensor\":\"%s\"}",
+        sprintf(jsondata, "{\"dev\":\"%x%x%x\",\"id\":\"sensorsetup\",\"specialsensor\":\"%s\",\"deadband\":%d,\"heartbeat\":%d}",
                     chipid[3],chipid[4],chipid[5],
-                    setup.specialsensor);
+                    setup.specialsensor,
+                    setup.deadband,
+                    setup.heartbeat);
         esp_mqtt_client_publish(client, setupTopic, jsondata , 0, 0, 1);
         vTaskDelay(10 / portTICK_PERIOD_MS);
         statistics_getptr()->sendcnt++;
@@ -666,7 +938,7 @@ static void wifi_event_handler(void *event_handler_arg, esp_event_base_t event_b
         gpio_set_level(WLANSTATUS_GPIO, true);
         retry_num = 0;
         healthyflags |= HEALTHYFLAGS_WIFI;
-        rgb7seg_display("lan",default_color->c);
+        rgb7seg_display(0, "lan",default_color->c, RGB7SEG_SRC_WIFI);
     }
 }
 
@@ -738,6 +1010,8 @@ void readSetup(void)
     char *colorname;
 
     strcpy(setup.specialsensor, flash_read_str(setup_flash, "specsensor", setup.specialsensor,12));
+    setup.deadband  = flash_read(setup_flash, "deadband", setup.deadband);
+    setup.heartbeat = flash_read(setup_flash, "heartbeat", setup.heartbeat);
     colorname = flash_read_str(setup_flash, "defaultcolor", default_color->name, 12);
     default_color = get_color(colorname);
 
@@ -747,10 +1021,34 @@ void readSetup(void)
     colorname = flash_read_str(setup_flash, "lowcolor", low_color->name, 12);
     low_color = get_color(colorname);
 
+    colorname = flash_read_str(setup_flash, "coloncolor", "", 12);
+    colon_color = get_color(colorname);
+    rgb7seg_set_indicator(RGB7SEG_COLON, colon_color ? &colon_color->c : NULL, true);
+
     setup.zonelow  = flash_read(setup_flash, "zonelow", setup.zonelow);
     setup.zonehigh = flash_read(setup_flash, "zonehigh", setup.zonehigh);
+    ds18b20_setPrecisionZone(setup.zonelow, setup.zonehigh);
 
     setup.showinternaltemp = flash_read(setup_flash, "inttemp", setup.showinternaltemp);
+    setup.brightness = flash_read(setup_flash, "brightness", setup.brightness);
+    rgb7seg_set_brightness(setup.brightness);
+}
+
+
+// geometry has to be known before the display is initialized
+static void readLayout(void)
+{
+    char *order;
+
+    rgb7seg_default_layout(&layout);
+    layout.digits  = flash_read(setup_flash, "digits", layout.digits);
+    layout.segleds = flash_read(setup_flash, "segleds", layout.segleds);
+    order = flash_read_str(setup_flash, "segorder", layout.order, sizeof(layout.order));
+    if (order != layout.order)
+    {
+        strncpy(layout.order, order, sizeof(layout.order) - 1);
+        free(order);
+    }
 }
 
 
@@ -785,7 +1083,9 @@ void app_main(void)
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     
-    rgb7seg_init();
+    setup_flash = flash_open("storage");
+    readLayout();
+    rgb7seg_init(&layout);
     gpio_reset_pin(BLINK_GPIO);
     gpio_reset_pin(WLANSTATUS_GPIO);
     gpio_reset_pin(SETUP_GPIO);
@@ -801,7 +1101,7 @@ void app_main(void)
     flash_open("storage");
     comminfo = get_networkinfo();
     
-    rgb7seg_display("init",default_color->c);
+    rgb7seg_display(0, "init",default_color->c, RGB7SEG_SRC_MAIN);
 
     if (comminfo == NULL)
     {
@@ -810,11 +1110,11 @@ void app_main(void)
     }
     else
     {
-        setup_flash = flash_open("storage");
         evt_queue = xQueueCreate(10, sizeof(struct measurement));
         
         gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);
         factoryreset_init();
+        ds18b20_useRoster(setup_flash);
         if (temperature_init(TEMP_BUS, appname, chipid, 2) > 0)
         {
             get_sensor_friendlynames();
@@ -860,6 +1160,12 @@ void app_main(void)
             {
                 ota_cancel_rollback();
             }
+            // sensors are numbered at boot, the new roster is taken in use by a restart
+            if (ds18b20_rosterChanged())
+            {
+                ESP_LOGW(TAG, "temperature sensors changed, restarting");
+                esp_restart();
+            }
 
             if (now > MIN_EPOCH)
             {
@@ -872,6 +1178,9 @@ void app_main(void)
                     if (isConnected)
                     {
                         statistics_send(client);
+                        sendDisplayStatistics(client, chipid);
+                        sendSensorStatistics(client, chipid);
+                        sendSensorResolutions(client, chipid);
                         prevStatsTs = now;
                     }
                 }
@@ -899,7 +1208,7 @@ void app_main(void)
                                     show_internaltemp(meas.data.temperature);
                                 }
                             }    
-                            if (isConnected) 
+                            if (isConnected && publishDue(&meas, now))
                             {
                                 temperature_send(comminfo->mqtt_prefix, &meas, client);
                             }    
@@ -919,7 +1228,7 @@ void app_main(void)
                         ota_status_publish(&meas, client);
                         if (meas.data.count == 0)
                         {
-                            rgb7seg_display("boot",default_color->c);
+                            rgb7seg_display(0, "boot",default_color->c, RGB7SEG_SRC_MAIN);
                             packetcount = 0;
                         }
                         else
@@ -928,7 +1237,7 @@ void app_main(void)
                             sprintf(buff,"%d",(int) (meas.data.count / 100));
                             if (packetcount == 3)
                             {
-                                rgb7seg_display(buff,default_color->c);
+                                rgb7seg_display(0, buff, default_color->c, RGB7SEG_SRC_MAIN);
                                 packetcount = 0;
                             } 
                             else
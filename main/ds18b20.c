@@ -12,11 +12,18 @@
     You should have received a copy of the GNU General Public License
      along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "driver/gpio.h"
+#include "driver/uart.h"
 #include "esp32/rom/ets_sys.h"
 #include "esp_timer.h"
+#include "esp_log.h"
+#include "flashmem.h"
 #include "ds18b20.h"
 
 // OneWire commands
@@ -48,90 +55,257 @@
 #define TEMP_11_BIT 0x5F // 11 bit
 #define TEMP_12_BIT 0x7F // 12 bit
 
-uint8_t DS_GPIO;
-uint8_t init=0;
-uint8_t bitResolution=12;
-uint8_t devices=0;
+#if CONFIG_TEMP_ONEWIRE_UART
+// Each time slot is one uart character at 115200 bps, tx and rx on the bus
+// pin. The start bit is the low pulse: 0xff is a write 1 or read slot, 0x00
+// a write 0. A sensor pulling the bus low shows in the echoed character.
+// The uart times the bus, so interrupts stay on. Buses take uarts from
+// CONFIG_TEMP_ONEWIRE_UART_NUM up, the rest are bit banged.
+#define OW_BAUD         115200
+#define OW_RESET_BAUD   9600   // 0xf0 at 9600 is a 520us reset pulse
+#define OW_TIMEOUT      (pdMS_TO_TICKS(20) + 1)
+static int next_uart = CONFIG_TEMP_ONEWIRE_UART_NUM;
+#endif
+static const char *TAG = "ds18b20";
 
-DeviceAddress ROM_NO;
-uint8_t LastDiscrepancy;
-uint8_t LastFamilyDiscrepancy;
-bool LastDeviceFlag;
+// Sensors found on the bus are kept in nvs. At boot a normal search returns
+// the stored addresses which answer with a valid scratchpad, instead of
+// walking the rom tree bit by bit. The real search runs after a conversion
+// every ROSTER_SCAN_US, first at boot only when there was no valid roster,
+// and updates the roster. Other sensors than in the roster have to be found
+// by two scans in a row, a sensor missing from one scan is not a change.
+// Each bus has a roster of its own.
+#define ROSTER_KEY      "dsroster"
+#define ROSTER_SCAN_US  (600 * 1000000LL)
+static nvs_handle roster_flash;
+static void roster_scan(ds18b20_bus_t *bus);
 
-/// Sends one bit to bus
-void ds18b20_write(char bit){
-	if (bit & 1) {
-		gpio_set_direction(DS_GPIO, GPIO_MODE_OUTPUT);
-		noInterrupts();
-		gpio_set_level(DS_GPIO,0);
-		ets_delay_us(6);
-		gpio_set_direction(DS_GPIO, GPIO_MODE_INPUT);	// release bus
-		ets_delay_us(64);
-		interrupts();
-	} else {
-		gpio_set_direction(DS_GPIO, GPIO_MODE_OUTPUT);
-		noInterrupts();
-		gpio_set_level(DS_GPIO,0);
-		ets_delay_us(60);
-		gpio_set_direction(DS_GPIO, GPIO_MODE_INPUT);	// release bus
-		ets_delay_us(10);
-		interrupts();
+// Each sensor converts at the resolution its readings call for. Near the
+// display zone limits or while the temperature changes, 12 bits. While it
+// is stable 10 bits, and 9 bits when it is also far from the zone limits.
+// All sensors of a bus convert together, so the wait is set by the most
+// precise one.
+#define RES_RATE_LIMIT      64     // 1/128 degrees per minute, 0.5 C/min is changing
+#define RES_ZONE_MARGIN     50     // 1/100 degrees, 12 bits this close to a zone limit
+#define RES_FAR_MARGIN      200    // 1/100 degrees, 9 bits this far from both limits
+#define RES_STABLE_READINGS 3
+static bool zone_set = false;
+static int zone_low, zone_high;   // 1/100 degrees
+static struct ds18b20_policy *policy_get(ds18b20_bus_t *bus, const DeviceAddress *deviceAddress);
+static void policy_update_wait(ds18b20_bus_t *bus);
+static bool resolution_policy(ds18b20_bus_t *bus, const DeviceAddress *deviceAddress, uint8_t *scratchPad, int16_t rawTemp);
+
+// Alarm sampling. Each sensor's TH/TL hold a window of deadband degrees
+// around its last reading rounded to a degree, so after a conversion only
+// the sensors which moved out of it answer the alarm search, and only those
+// are read.
+// A sensor which lost power has its TH/TL back from eeprom, so every
+// SAMPLE_FULL_CYCLES all sensors are read anyway.
+#define SAMPLE_FULL_CYCLES  60
+
+static int bus_count = 0;
+// bus of the functions without a bus argument, set up by ds18b20_init()
+static ds18b20_bus_t legacy_bus;
+
+#if CONFIG_TEMP_ONEWIRE_UART
+// sends the slots and replaces them with what was on the bus
+static bool uart_slots(ds18b20_bus_t *bus, uint8_t *slots, int n){
+	uart_flush_input(bus->uart);
+	uart_write_bytes(bus->uart, slots, n);
+	return uart_read_bytes(bus->uart, slots, n, OW_TIMEOUT) == n;
+}
+
+static unsigned char uart_reset(ds18b20_bus_t *bus){
+	uint8_t c = 0xf0;
+	uart_set_baudrate(bus->uart, OW_RESET_BAUD);
+	bool ok = uart_slots(bus, &c, 1);
+	uart_set_baudrate(bus->uart, OW_BAUD);
+	return ok && c != 0xf0;   // presence pulse overwrote some of the bits
+}
+
+static void uart_write(ds18b20_bus_t *bus, char bit){
+	uint8_t c = (bit & 1) ? 0xff : 0x00;
+	uart_slots(bus, &c, 1);
+}
+
+static unsigned char uart_read(ds18b20_bus_t *bus){
+	uint8_t c = 0xff;
+	uart_slots(bus, &c, 1);
+	return (c == 0xff);
+}
+
+static void uart_write_byte(ds18b20_bus_t *bus, char data){
+	uint8_t slots[8];
+	for (int i = 0; i < 8; i++) slots[i] = ((data>>i) & 0x01) ? 0xff : 0x00;
+	uart_slots(bus, slots, 8);
+}
+
+static unsigned char uart_read_byte(ds18b20_bus_t *bus){
+	uint8_t slots[8];
+	unsigned char data = 0;
+	memset(slots, 0xff, sizeof(slots));
+	uart_slots(bus, slots, 8);
+	for (int i = 0; i < 8; i++) if (slots[i] == 0xff) data|=0x01<<i;
+	return(data);
+}
+
+static const struct ds18b20_bus_ops uart_ops = {
+	.reset = uart_reset,
+	.write = uart_write,
+	.read = uart_read,
+	.write_byte = uart_write_byte,
+	.read_byte = uart_read_byte,
+};
+
+static bool uart_init(int uart, int gpio){
+	uart_config_t uart_config = {
+		.baud_rate = OW_BAUD,
+		.data_bits = UART_DATA_8_BITS,
+		.parity = UART_PARITY_DISABLE,
+		.stop_bits = UART_STOP_BITS_1,
+		.flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+		.source_clk = UART_SCLK_DEFAULT,
+	};
+	if (uart_driver_install(uart, 256, 0, 0, NULL, 0) != ESP_OK) return false;
+	if (uart_param_config(uart, &uart_config) != ESP_OK ||
+		uart_set_pin(uart, gpio, gpio, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE) != ESP_OK) {
+		uart_driver_delete(uart);
+		return false;
 	}
+	// rx setup turned the output off, open drain lets the sensors pull the bus low
+	gpio_set_direction(gpio, GPIO_MODE_INPUT_OUTPUT_OD);
+	gpio_set_pull_mode(gpio, GPIO_PULLUP_ONLY);
+	uart_set_rx_timeout(uart, 1);   // echo is passed on after one idle character
+	return true;
+}
+#endif
+
+/// Sends one bit to bus
+static void bitbang_write(ds18b20_bus_t *bus, char bit){
+	int low = (bit & 1) ? 6 : 60;
+	int64_t start = esp_timer_get_time();
+	gpio_set_direction(bus->gpio, GPIO_MODE_OUTPUT);
+	noInterrupts();
+	gpio_set_level(bus->gpio,0);
+	ets_delay_us(low);
+	gpio_set_direction(bus->gpio, GPIO_MODE_INPUT);	// release bus
+	ets_delay_us(70 - low);
+	interrupts();
+	bus->critical_us += esp_timer_get_time() - start;
 }
 
 // Reads one bit from bus
-unsigned char ds18b20_read(void){
+static unsigned char bitbang_read(ds18b20_bus_t *bus){
 	unsigned char value = 0;
-	gpio_set_direction(DS_GPIO, GPIO_MODE_OUTPUT);
+	int64_t start = esp_timer_get_time();
+	gpio_set_direction(bus->gpio, GPIO_MODE_OUTPUT);
 	noInterrupts();
-	gpio_set_level(DS_GPIO, 0);
+	gpio_set_level(bus->gpio, 0);
 	ets_delay_us(6);
-	gpio_set_direction(DS_GPIO, GPIO_MODE_INPUT);
+	gpio_set_direction(bus->gpio, GPIO_MODE_INPUT);
 	ets_delay_us(9);
-	value = gpio_get_level(DS_GPIO);
+	value = gpio_get_level(bus->gpio);
 	ets_delay_us(55);
 	interrupts();
+	bus->critical_us += esp_timer_get_time() - start;
 	return (value);
 }
 // Sends one byte to bus
-void ds18b20_write_byte(char data){
+static void bitbang_write_byte(ds18b20_bus_t *bus, char data){
   unsigned char i;
   unsigned char x;
   for(i=0;i<8;i++){
     x = data>>i;
     x &= 0x01;
-    ds18b20_write(x);
+    bitbang_write(bus, x);
   }
   ets_delay_us(100);
 }
 // Reads one byte from bus
-unsigned char ds18b20_read_byte(void){
+static unsigned char bitbang_read_byte(ds18b20_bus_t *bus){
   unsigned char i;
   unsigned char data = 0;
   for (i=0;i<8;i++)
   {
-    if(ds18b20_read()) data|=0x01<<i;
+    if(bitbang_read(bus)) data|=0x01<<i;
     ets_delay_us(15);
   }
   return(data);
 }
 // Sends reset pulse
-unsigned char ds18b20_reset(void){
+static unsigned char bitbang_reset(ds18b20_bus_t *bus){
 	unsigned char presence;
-	gpio_set_direction(DS_GPIO, GPIO_MODE_OUTPUT);
+	int64_t start = esp_timer_get_time();
+	gpio_set_direction(bus->gpio, GPIO_MODE_OUTPUT);
 	noInterrupts();
-	gpio_set_level(DS_GPIO, 0);
+	gpio_set_level(bus->gpio, 0);
 	ets_delay_us(480);
-	gpio_set_level(DS_GPIO, 1);
-	gpio_set_direction(DS_GPIO, GPIO_MODE_INPUT);
+	gpio_set_level(bus->gpio, 1);
+	gpio_set_direction(bus->gpio, GPIO_MODE_INPUT);
 	ets_delay_us(70);
-	presence = (gpio_get_level(DS_GPIO) == 0);
+	presence = (gpio_get_level(bus->gpio) == 0);
 	ets_delay_us(410);
 	interrupts();
+	bus->critical_us += esp_timer_get_time() - start;
 	return presence;
 }
 
-bool ds18b20_setResolution(const DeviceAddress tempSensorAddresses[], int numAddresses, uint8_t newResolution) {
+static const struct ds18b20_bus_ops bitbang_ops = {
+	.reset = bitbang_reset,
+	.write = bitbang_write,
+	.read = bitbang_read,
+	.write_byte = bitbang_write_byte,
+	.read_byte = bitbang_read_byte,
+};
+
+// Everything on the wire goes through the ops of the bus, and is counted
+// in time slots. A reset is counted apart, it takes about 14 slots.
+void ds18b20_bus_write(ds18b20_bus_t *bus, char bit){
+	bus->slots.writes++;
+	bus->ops->write(bus, bit);
+}
+
+unsigned char ds18b20_bus_read(ds18b20_bus_t *bus){
+	bus->slots.reads++;
+	return bus->ops->read(bus);
+}
+
+void ds18b20_bus_write_byte(ds18b20_bus_t *bus, char data){
+	bus->slots.writes += 8;
+	bus->ops->write_byte(bus, data);
+}
+
+unsigned char ds18b20_bus_read_byte(ds18b20_bus_t *bus){
+	bus->slots.reads += 8;
+	return bus->ops->read_byte(bus);
+}
+
+unsigned char ds18b20_bus_reset(ds18b20_bus_t *bus){
+	bus->slots.resets++;
+	return bus->ops->reset(bus);
+}
+
+// microseconds spent with interrupts disabled since boot, 0 with the uart bus
+uint32_t ds18b20_bus_criticalTime(ds18b20_bus_t *bus){
+	return bus->critical_us;
+}
+
+// Slots used since boot, a difference over one polling cycle tells what
+// the cycle costs on the wire.
+const struct ds18b20_slots *ds18b20_bus_slots(ds18b20_bus_t *bus){
+	return &bus->slots;
+}
+
+// Replaces the wire of the bus, for example with a simulated one. Call
+// before ds18b20_bus_init(), which then leaves the gpio alone.
+void ds18b20_bus_set_ops(ds18b20_bus_t *bus, const struct ds18b20_bus_ops *ops, void *ctx){
+	bus->ops = ops;
+	bus->ops_ctx = ctx;
+}
+
+// Starts the policy of each sensor again from the given resolution. Asking
+// again for the same one leaves the resolution the policy chose since.
+bool ds18b20_bus_setResolution(ds18b20_bus_t *bus, const DeviceAddress tempSensorAddresses[], int numAddresses, uint8_t newResolution) {
 	bool success = false;
 	// handle the sensors with configuration register
 	newResolution = constrain(newResolution, 9, 12);
@@ -140,7 +314,10 @@ bool ds18b20_setResolution(const DeviceAddress tempSensorAddresses[], int numAdd
 	// loop through each address
 	for (int i = 0; i < numAddresses; i++){
 		// we can only update the sensor if it is connected
-		if (ds18b20_isConnected((DeviceAddress*) tempSensorAddresses[i], scratchPad)) {
+		if (ds18b20_bus_isConnected(bus, (DeviceAddress*) tempSensorAddresses[i], scratchPad)) {
+			struct ds18b20_policy *p = policy_get(bus, (const DeviceAddress *) tempSensorAddresses[i]);
+			success = true;
+			if (p != NULL && p->requested == newResolution) continue;
 			switch (newResolution) {
 			case 12:
 				newValue = TEMP_12_BIT;
@@ -159,31 +336,35 @@ bool ds18b20_setResolution(const DeviceAddress tempSensorAddresses[], int numAdd
 			// if it needs to be updated we write the new value
 			if (scratchPad[CONFIGURATION] != newValue) {
 				scratchPad[CONFIGURATION] = newValue;
-				ds18b20_writeScratchPad((DeviceAddress*) tempSensorAddresses[i], scratchPad);
+				ds18b20_bus_writeScratchPad(bus, (DeviceAddress*) tempSensorAddresses[i], scratchPad);
+			}
+			if (p != NULL) {
+				p->resolution = newResolution;
+				p->requested = newResolution;
+				p->stable = 0;
 			}
-			// done
-			success = true;
 		}
 	}
+	policy_update_wait(bus);
 	return success;
 }
 
-void ds18b20_writeScratchPad(const DeviceAddress *deviceAddress, const uint8_t *scratchPad) {
-	ds18b20_reset();
-	ds18b20_select(deviceAddress);
-	ds18b20_write_byte(WRITESCRATCH);
-	ds18b20_write_byte(scratchPad[HIGH_ALARM_TEMP]); // high alarm temp
-	ds18b20_write_byte(scratchPad[LOW_ALARM_TEMP]); // low alarm temp
-	ds18b20_write_byte(scratchPad[CONFIGURATION]);
-	ds18b20_reset();
+void ds18b20_bus_writeScratchPad(ds18b20_bus_t *bus, const DeviceAddress *deviceAddress, const uint8_t *scratchPad) {
+	ds18b20_bus_reset(bus);
+	ds18b20_bus_select(bus, deviceAddress);
+	ds18b20_bus_write_byte(bus, WRITESCRATCH);
+	ds18b20_bus_write_byte(bus, scratchPad[HIGH_ALARM_TEMP]); // high alarm temp
+	ds18b20_bus_write_byte(bus, scratchPad[LOW_ALARM_TEMP]); // low alarm temp
+	ds18b20_bus_write_byte(bus, scratchPad[CONFIGURATION]);
+	ds18b20_bus_reset(bus);
 }
 
-bool ds18b20_readScratchPad(const DeviceAddress *deviceAddress, uint8_t* scratchPad) {
+bool ds18b20_bus_readScratchPad(ds18b20_bus_t *bus, const DeviceAddress *deviceAddress, uint8_t* scratchPad) {
 	// send the reset command and fail fast
-	int b = ds18b20_reset();
+	int b = ds18b20_bus_reset(bus);
 	if (b == 0) return false;
-	ds18b20_select(deviceAddress);
-	ds18b20_write_byte(READSCRATCH);
+	ds18b20_bus_select(bus, deviceAddress);
+	ds18b20_bus_write_byte(bus, READSCRATCH);
 	// Read all registers in a simple loop
 	// byte 0: temperature LSB
 	// byte 1: temperature MSB
@@ -195,33 +376,64 @@ bool ds18b20_readScratchPad(const DeviceAddress *deviceAddress, uint8_t* scratch
 	// byte 7: DS18B20 & DS1822: store for crc
 	// byte 8: SCRATCHPAD_CRC
 	for (uint8_t i = 0; i < 9; i++) {
-		scratchPad[i] = ds18b20_read_byte();
+		scratchPad[i] = ds18b20_bus_read_byte(bus);
 	}
-	b = ds18b20_reset();
+	b = ds18b20_bus_reset(bus);
 	return (b == 1);
 }
 
-void ds18b20_select(const DeviceAddress *address){
+void ds18b20_bus_select(ds18b20_bus_t *bus, const DeviceAddress *address){
     uint8_t i;
-    ds18b20_write_byte(SELECTDEVICE);           // Choose ROM
-    for (i = 0; i < 8; i++) ds18b20_write_byte(((uint8_t *)address)[i]);
+    ds18b20_bus_write_byte(bus, SELECTDEVICE);           // Choose ROM
+    for (i = 0; i < 8; i++) ds18b20_bus_write_byte(bus, ((uint8_t *)address)[i]);
 }
 
-void ds18b20_requestTemperatures(){
-	ds18b20_reset();
-	ds18b20_write_byte(SKIPROM);
-	ds18b20_write_byte(GETTEMP);
-    unsigned long start = esp_timer_get_time() / 1000ULL;
-    while (!isConversionComplete() && ((esp_timer_get_time() / 1000ULL) - start < millisToWaitForConversion())) vPortYield();
+static void conv_timer_cb(void *arg){
+	ds18b20_bus_t *bus = arg;
+	bus->conv_pending = false;
+	if (bus->conv_task != NULL)
+		xTaskNotify(bus->conv_task, bus->conv_bits, eSetBits);
+	else
+		xSemaphoreGive(bus->conv_done);
 }
 
-bool isConversionComplete() {
-	uint8_t b = ds18b20_read();
+// Starts conversion on all sensors and returns at once. When the results are
+// ready, bits are set in the notification value of task, or the internal
+// semaphore is given if task is NULL. False if no sensor answered or a
+// conversion is already going on.
+bool ds18b20_bus_startConversion(ds18b20_bus_t *bus, TaskHandle_t task, uint32_t bits){
+	if (bus->conv_pending) return false;
+	if (!ds18b20_bus_reset(bus)) return false;
+	ds18b20_bus_write_byte(bus, SKIPROM);
+	ds18b20_bus_write_byte(bus, GETTEMP);
+	bus->conv_task = task;
+	bus->conv_bits = bits;
+	bus->conv_pending = true;
+	ESP_ERROR_CHECK(esp_timer_start_once(bus->conv_timer, ds18b20_bus_millisToWaitForConversion(bus) * 1000ULL));
+	return true;
+}
+
+bool ds18b20_bus_conversionPending(ds18b20_bus_t *bus){
+	return bus->conv_pending;
+}
+
+// blocks the calling task until the conversion time is over, without touching the bus
+void ds18b20_bus_requestTemperatures(ds18b20_bus_t *bus){
+	xSemaphoreTake(bus->conv_done, 0);
+	if (ds18b20_bus_startConversion(bus, NULL, 0))
+		xSemaphoreTake(bus->conv_done, portMAX_DELAY);
+	// bus is free until the caller reads the results
+	if (bus->roster_scanned == 0 || esp_timer_get_time() - bus->roster_scanned > ROSTER_SCAN_US)
+		roster_scan(bus);
+}
+
+bool ds18b20_bus_isConversionComplete(ds18b20_bus_t *bus) {
+	uint8_t b = ds18b20_bus_read(bus);
 	return (b == 1);
 }
 
-uint16_t millisToWaitForConversion() {
-	switch (bitResolution) {
+uint16_t ds18b20_bus_millisToWaitForConversion(ds18b20_bus_t *bus) {
+	switch (bus->bitResolution) {
 	case 9:
 		return 94;
 	case 10:
@@ -233,8 +445,8 @@ uint16_t millisToWaitForConversion() {
 	}
 }
 
-bool ds18b20_isConnected(const DeviceAddress *deviceAddress, uint8_t *scratchPad) {
-	bool b = ds18b20_readScratchPad(deviceAddress, scratchPad);
+bool ds18b20_bus_isConnected(ds18b20_bus_t *bus, const DeviceAddress *deviceAddress, uint8_t *scratchPad) {
+	bool b = ds18b20_bus_readScratchPad(bus, deviceAddress, scratchPad);
 	return b && !ds18b20_isAllZeros(scratchPad) && (ds18b20_crc8(scratchPad, 8) == scratchPad[SCRATCHPAD_CRC]);
 }
 
@@ -257,12 +469,14 @@ bool ds18b20_isAllZeros(const uint8_t * const scratchPad) {
 	return true;
 }
 
-float ds18b20_getTempF(const DeviceAddress *deviceAddress) {
+float ds18b20_bus_getTempF(ds18b20_bus_t *bus, const DeviceAddress *deviceAddress) {
 	ScratchPad scratchPad;
-	if (ds18b20_isConnected(deviceAddress, scratchPad)){
+	if (ds18b20_bus_isConnected(bus, deviceAddress, scratchPad)){
 		int16_t rawTemp = calculateTemperature(deviceAddress, scratchPad);
 		if (rawTemp <= DEVICE_DISCONNECTED_RAW)
 			return DEVICE_DISCONNECTED_F;
+		if (resolution_policy(bus, deviceAddress, scratchPad, rawTemp))
+			ds18b20_bus_writeScratchPad(bus, deviceAddress, scratchPad);
 		// C = RAW/128
 		// F = (C*1.8)+32 = (RAW/128*1.8)+32 = (RAW*0.0140625)+32
 		return ((float) rawTemp * 0.0140625f) + 32.0f;
@@ -270,12 +484,14 @@ float ds18b20_getTempF(const DeviceAddress *deviceAddress) {
 	return DEVICE_DISCONNECTED_F;
 }
 
-float ds18b20_getTempC(const DeviceAddress *deviceAddress) {
+float ds18b20_bus_getTempC(ds18b20_bus_t *bus, const DeviceAddress *deviceAddress) {
 	ScratchPad scratchPad;
-	if (ds18b20_isConnected(deviceAddress, scratchPad)) {
+	if (ds18b20_bus_isConnected(bus, deviceAddress, scratchPad)) {
 		int16_t rawTemp = calculateTemperature(deviceAddress, scratchPad);
 		if (rawTemp <= DEVICE_DISCONNECTED_RAW)
 			return DEVICE_DISCONNECTED_C;
+		if (resolution_policy(bus, deviceAddress, scratchPad, rawTemp))
+			ds18b20_bus_writeScratchPad(bus, deviceAddress, scratchPad);
 		// C = RAW/128
 		// F = (C*1.8)+32 = (RAW/128*1.8)+32 = (RAW*0.0140625)+32
 		return (float) rawTemp/128.0f;
@@ -285,13 +501,170 @@ float ds18b20_getTempC(const DeviceAddress *deviceAddress) {
 
 // reads scratchpad and returns fixed-point temperature, scaling factor 2^-7
 int16_t calculateTemperature(const DeviceAddress *deviceAddress, uint8_t* scratchPad) {
-	int16_t fpTemperature = (((int16_t) scratchPad[TEMP_MSB]) << 11) | (((int16_t) scratchPad[TEMP_LSB]) << 3);
+	// below 12 bits the lowest bits are undefined
+	static const uint8_t undefined[4] = { 0x07, 0x03, 0x01, 0x00 };
+	uint8_t lsb = scratchPad[TEMP_LSB] & ~undefined[(scratchPad[CONFIGURATION] >> 5) & 0x03];
+	int16_t fpTemperature = (((int16_t) scratchPad[TEMP_MSB]) << 11) | (((int16_t) lsb) << 3);
 	return fpTemperature;
 }
 
+static struct ds18b20_policy *policy_get(ds18b20_bus_t *bus, const DeviceAddress *deviceAddress) {
+	for (int i = 0; i < bus->policy_count; i++) {
+		if (!memcmp(bus->policies[i].addr, deviceAddress, sizeof(DeviceAddress)))
+			return &bus->policies[i];
+	}
+	if (bus->policy_count == DS18B20_ROSTER_MAX)
+		return NULL;
+	struct ds18b20_policy *p = &bus->policies[bus->policy_count++];
+	memcpy(p->addr, deviceAddress, sizeof(DeviceAddress));
+	p->resolution = 12;
+	return p;
+}
+
+// conversion time follows the most precise sensor
+static void policy_update_wait(ds18b20_bus_t *bus) {
+	uint8_t res = 9;
+	for (int i = 0; i < bus->policy_count; i++) {
+		if (bus->policies[i].resolution > res) res = bus->policies[i].resolution;
+	}
+	bus->bitResolution = res;
+}
+
+// Picks the resolution of the next conversion from a valid reading, and
+// puts it in the scratchpad just read. A sensor which lost power comes back
+// at its eeprom resolution, so the configuration is compared with the
+// scratchpad on every reading. Returns true when the scratchpad has to be
+// written back.
+static bool resolution_policy(ds18b20_bus_t *bus, const DeviceAddress *deviceAddress, uint8_t *scratchPad, int16_t rawTemp) {
+	struct ds18b20_policy *p = policy_get(bus, deviceAddress);
+	int64_t now = esp_timer_get_time();
+	uint8_t res = 12;
+
+	if (p == NULL) return false;
+	if (p->lastts) {
+		int64_t dt = now - p->lastts;
+		int32_t rate = dt > 0 ? abs(rawTemp - p->last) * 60000000LL / dt : RES_RATE_LIMIT;
+		if (rate >= RES_RATE_LIMIT)
+			p->stable = 0;
+		else if (p->stable < RES_STABLE_READINGS)
+			p->stable++;
+	}
+	p->last = rawTemp;
+	p->lastts = now;
+
+	if (p->stable >= RES_STABLE_READINGS) {
+		int centi = rawTemp * 100 / 128;
+		int distance = RES_FAR_MARGIN;
+		if (zone_set) {
+			int dlow = abs(centi - zone_low), dhigh = abs(centi - zone_high);
+			distance = dlow < dhigh ? dlow : dhigh;
+		}
+		if (distance >= RES_FAR_MARGIN) res = 9;
+		else if (distance > RES_ZONE_MARGIN) res = 10;
+	}
+	if (res != p->resolution) {
+		p->resolution = res;
+		policy_update_wait(bus);
+	}
+	if (((scratchPad[CONFIGURATION] >> 5) & 0x03) == res - 9) return false;
+
+	static const uint8_t config[4] = { TEMP_9_BIT, TEMP_10_BIT, TEMP_11_BIT, TEMP_12_BIT };
+	scratchPad[CONFIGURATION] = config[res - 9];
+	return true;
+}
+
+// display zone limits in 1/100 degrees, readings near them are converted at 12 bits
+void ds18b20_setPrecisionZone(int low, int high) {
+	zone_low = low;
+	zone_high = high;
+	zone_set = true;
+}
+
+// resolution of the sensor's next conversion, 0 if it was not read yet
+uint8_t ds18b20_bus_getSensorResolution(ds18b20_bus_t *bus, const DeviceAddress *deviceAddress) {
+	for (int i = 0; i < bus->policy_count; i++) {
+		if (!memcmp(bus->policies[i].addr, deviceAddress, sizeof(DeviceAddress)))
+			return bus->policies[i].resolution;
+	}
+	return 0;
+}
+
+// address of the index'th sensor with a resolution policy, NULL after the last
+const DeviceAddress *ds18b20_bus_getPolicySensor(ds18b20_bus_t *bus, int index) {
+	return (index < bus->policy_count) ? (const DeviceAddress *) &bus->policies[index].addr : NULL;
+}
+
+// The sensor alarms when the integer degrees of a conversion are >= TH or
+// <= TL. With the reading rounded to whole degrees W, TH = W + deadband and
+// TL = W - deadband - 1 alarm outside [W - deadband, W + deadband), which is
+// deadband degrees either way, give or take half a degree of rounding.
+// Returns true when the scratchpad has to be written back.
+static bool alarm_window(uint8_t *scratchPad, int16_t rawTemp, int deadband) {
+	int whole = (rawTemp + 64) >> 7;
+	int high = whole + deadband, low = whole - deadband - 1;
+
+	if (high > 125) high = 125;
+	if (low < -55) low = -55;
+	if ((int8_t) scratchPad[HIGH_ALARM_TEMP] == high && (int8_t) scratchPad[LOW_ALARM_TEMP] == low)
+		return false;
+	scratchPad[HIGH_ALARM_TEMP] = (uint8_t) high;
+	scratchPad[LOW_ALARM_TEMP] = (uint8_t) low;
+	return true;
+}
+
+// Converts all sensors and reads only those that left the window of about
+// deadband whole degrees around their last reading. temps[] keeps the last
+// reading of each sensor between the calls, DEVICE_DISCONNECTED_C when it
+// did not answer.
+// Returns how many sensors were read.
+int ds18b20_bus_sampleChanged(ds18b20_bus_t *bus, const DeviceAddress sensors[], int numSensors, float temps[], int deadband) {
+	DeviceAddress alarmed[DS18B20_ROSTER_MAX];
+	uint8_t addr[8];
+	int numAlarmed = 0, numRead = 0;
+	bool full;
+
+	if (deadband < 1) deadband = 1;
+	ds18b20_bus_requestTemperatures(bus);
+	full = ++bus->sample_cycles >= SAMPLE_FULL_CYCLES;
+	if (full) {
+		bus->sample_cycles = 0;
+	} else {
+		ds18b20_bus_reset_search(bus);
+		while (numAlarmed < DS18B20_ROSTER_MAX && ds18b20_bus_search(bus, addr, false))
+			memcpy(alarmed[numAlarmed++], addr, sizeof(DeviceAddress));
+		ds18b20_bus_reset_search(bus);
+	}
+
+	for (int i = 0; i < numSensors; i++) {
+		const DeviceAddress *deviceAddress = &sensors[i];
+		struct ds18b20_policy *p = policy_get(bus, deviceAddress);
+		ScratchPad scratchPad;
+		bool moved = full || p == NULL || !p->alarmed;
+
+		for (int j = 0; !moved && j < numAlarmed; j++)
+			moved = !memcmp(alarmed[j], deviceAddress, sizeof(DeviceAddress));
+		if (!moved) continue;
+
+		numRead++;
+		temps[i] = DEVICE_DISCONNECTED_C;
+		if (p) p->alarmed = false;
+		if (!ds18b20_bus_isConnected(bus, deviceAddress, scratchPad)) continue;
+		int16_t rawTemp = calculateTemperature(deviceAddress, scratchPad);
+		if (rawTemp <= DEVICE_DISCONNECTED_RAW) continue;
+		// one write for both the resolution and the alarm window
+		bool write = resolution_policy(bus, deviceAddress, scratchPad, rawTemp);
+		write |= alarm_window(scratchPad, rawTemp, deadband);
+		if (write)
+			ds18b20_bus_writeScratchPad(bus, deviceAddress, scratchPad);
+		if (p) p->alarmed = true;
+		temps[i] = (float) rawTemp/128.0f;
+	}
+	return numRead;
+}
+
 // Returns temperature from sensor
 float ds18b20_get_temp(void) {
-  if(init==1){
+  if(legacy_bus.conv_timer != NULL){
     unsigned char check;
     char temp1=0, temp2=0;
       check=ds18b20_RST_PULSE();
@@ -316,26 +689,130 @@ float ds18b20_get_temp(void) {
   else{return 0;}
 }
 
-void ds18b20_init(int GPIO) {
-	DS_GPIO = GPIO;
-	esp_rom_gpio_pad_select_gpio(DS_GPIO);
-	//gpio_pad_select_gpio(DS_GPIO);
-	init = 1;
+// Sets up a bus on the gpio. The bus must be zeroed before the first init,
+// after that it may be used from one task at a time. Buses on different
+// gpios are independent and can be polled from tasks of their own.
+void ds18b20_bus_init(ds18b20_bus_t *bus, int GPIO) {
+	if (bus->conv_timer != NULL) return;
+	bus->gpio = GPIO;
+	bus->index = bus_count++;
+	bus->uart = -1;
+	bus->bitResolution = 12;
+	bus->roster_replay = -1;
+	if (bus->ops == NULL) {
+		bus->ops = &bitbang_ops;
+		esp_rom_gpio_pad_select_gpio(bus->gpio);
+		//gpio_pad_select_gpio(bus->gpio);
+#if CONFIG_TEMP_ONEWIRE_UART
+		if (next_uart < UART_NUM_MAX && uart_init(next_uart, GPIO)) {
+			bus->uart = next_uart++;
+			bus->ops = &uart_ops;
+			ESP_LOGI(TAG, "1-wire bus %d on uart %d", bus->index, bus->uart);
+		} else {
+			ESP_LOGW(TAG, "no uart for 1-wire bus %d, bit banging gpio %d", bus->index, GPIO);
+		}
+#endif
+	}
+	esp_timer_create_args_t conv_args = {
+		.callback = conv_timer_cb,
+		.arg = bus,
+		.name = "ds18b20 conversion",
+	};
+	ESP_ERROR_CHECK(esp_timer_create(&conv_args, &bus->conv_timer));
+	bus->conv_done = xSemaphoreCreateBinary();
+}
+
+static uint8_t roster_crc(const struct ds18b20_roster *r){
+	return ds18b20_crc8((const uint8_t *) r, offsetof(struct ds18b20_roster, crc));
+}
+
+// first bus keeps the key it had before there were several
+static void roster_key(ds18b20_bus_t *bus, char *key){
+	if (bus->index == 0)
+		strcpy(key, ROSTER_KEY);
+	else
+		sprintf(key, ROSTER_KEY "%d", bus->index);
+}
+
+static void roster_load(ds18b20_bus_t *bus){
+	char key[16];
+
+	bus->roster_loaded = true;
+	roster_key(bus, key);
+	bus->roster_valid = flash_read_blob(roster_flash, key, &bus->roster, sizeof(bus->roster)) &&
+		bus->roster.count <= DS18B20_ROSTER_MAX && roster_crc(&bus->roster) == bus->roster.crc;
+	if (bus->roster_valid) {
+		ESP_LOGI(TAG, "%d sensors in roster of bus %d", bus->roster.count, bus->index);
+		// replayed at boot, the bus is searched on the usual schedule
+		bus->roster_scanned = esp_timer_get_time();
+	}
+	else
+		bus->roster.count = 0;
+}
+
+// Keeps the sensor rosters in nvs, call before the first search.
+void ds18b20_useRoster(nvs_handle nvsh){
+	roster_flash = nvsh;
+}
+
+// true when the background search found other sensors than there were at boot
+bool ds18b20_bus_rosterChanged(ds18b20_bus_t *bus){
+	return bus->roster_changed;
+}
+
+static bool search_rom(ds18b20_bus_t *bus, uint8_t *newAddr, bool search_mode);
+static bool search_valid(ds18b20_bus_t *bus, uint8_t *newAddr, bool search_mode);
+
+static void roster_scan(ds18b20_bus_t *bus){
+	struct ds18b20_roster found = {0};
+	uint8_t addr[8];
+
+	bus->roster_scanned = esp_timer_get_time();
+	bus->roster_searched = true;
+	ds18b20_bus_reset_search(bus);
+	while (found.count < DS18B20_ROSTER_MAX && search_valid(bus, addr, true))
+		memcpy(found.addr[found.count++], addr, sizeof(DeviceAddress));
+	ds18b20_bus_reset_search(bus);
+	found.crc = roster_crc(&found);
+	if (!bus->roster_loaded || (bus->roster_valid && !memcmp(&found, &bus->roster, sizeof(bus->roster)))) {
+		bus->roster_pending = false;
+		return;
+	}
+	if (bus->roster_valid && (!bus->roster_pending || memcmp(&found, &bus->roster_candidate, sizeof(found)))) {
+		ESP_LOGI(TAG, "%d sensors found instead of %d, waiting for the next scan", found.count, bus->roster.count);
+		bus->roster_candidate = found;
+		bus->roster_pending = true;
+		return;
+	}
+	bus->roster_pending = false;
+	if (bus->roster_valid) {
+		ESP_LOGW(TAG, "sensors changed from %d to %d", bus->roster.count, found.count);
+		bus->roster_changed = true;
+	}
+	bus->roster = found;
+	bus->roster_valid = true;
+	char key[16];
+	roster_key(bus, key);
+	flash_write_blob(roster_flash, key, &bus->roster, sizeof(bus->roster));
+	flash_commitchanges(roster_flash);
 }
 
 //
 // You need to use this function to start a search again from the beginning.
 // You do not need to do it for the first search, though you could.
 //
-void reset_search() {
-	devices=0;
+void ds18b20_bus_reset_search(ds18b20_bus_t *bus) {
+	bus->devices=0;
 	// reset the search state
-	LastDiscrepancy = 0;
-	LastDeviceFlag = false;
-	LastFamilyDiscrepancy = 0;
+	bus->LastDiscrepancy = 0;
+	bus->LastDeviceFlag = false;
+	bus->LastFamilyDiscrepancy = 0;
 	for (int i = 7; i >= 0; i--) {
-		ROM_NO[i] = 0;
+		bus->ROM_NO[i] = 0;
 	}
+	if (!bus->roster_loaded && roster_flash != 0)
+		roster_load(bus);
+	bus->roster_replay = (bus->roster_valid && !bus->roster_searched) ? 0 : -1;
 }
 // --- Replaced by the one from the Dallas Semiconductor web site ---
 //--------------------------------------------------------------------------
@@ -344,7 +821,43 @@ void reset_search() {
 // Return TRUE  : device found, ROM number in ROM_NO buffer
 //        FALSE : device not found, end of search
 
-bool search(uint8_t *newAddr, bool search_mode) {
+// Until the first background scan, a normal search returns the roster
+// addresses which answer. If none of them does, the bus is searched.
+bool ds18b20_bus_search(ds18b20_bus_t *bus, uint8_t *newAddr, bool search_mode) {
+	if (search_mode && bus->roster_replay >= 0) {
+		ScratchPad scratchPad;
+		while (bus->roster_replay < bus->roster.count) {
+			DeviceAddress *addr = &bus->roster.addr[bus->roster_replay++];
+			if (ds18b20_bus_isConnected(bus, (const DeviceAddress *) addr, scratchPad)) {
+				memcpy(newAddr, addr, sizeof(DeviceAddress));
+				bus->devices++;
+				return true;
+			}
+			ESP_LOGI(TAG, "roster sensor %d does not answer", bus->roster_replay - 1);
+		}
+		bus->roster_replay = -1;
+		if (bus->devices) {
+			bus->devices = 0;
+			return false;
+		}
+		ds18b20_bus_reset_search(bus);
+		bus->roster_replay = -1;
+	}
+	return search_valid(bus, newAddr, search_mode);
+}
+
+// a rom read with a bad crc is skipped, the search goes on with the next one
+static bool search_valid(ds18b20_bus_t *bus, uint8_t *newAddr, bool search_mode){
+	while (search_rom(bus, newAddr, search_mode)) {
+		if (ds18b20_crc8(newAddr, 7) == newAddr[DSROM_CRC])
+			return true;
+		ESP_LOGW(TAG, "search skipped a rom with a bad crc");
+		bus->devices--;
+	}
+	return false;
+}
+
+static bool search_rom(ds18b20_bus_t *bus, uint8_t *newAddr, bool search_mode) {
 	uint8_t id_bit_number;
 	uint8_t last_zero, rom_byte_number;
 	bool search_result;
@@ -360,28 +873,28 @@ bool search(uint8_t *newAddr, bool search_mode) {
 	search_result = false;
 
 	// if the last call was not the last one
-	if (!LastDeviceFlag) {
+	if (!bus->LastDeviceFlag) {
 		// 1-Wire reset
-		if (!ds18b20_reset()) {
+		if (!ds18b20_bus_reset(bus)) {
 			// reset the search
-			LastDiscrepancy = 0;
-			LastDeviceFlag = false;
-			LastFamilyDiscrepancy = 0;
+			bus->LastDiscrepancy = 0;
+			bus->LastDeviceFlag = false;
+			bus->LastFamilyDiscrepancy = 0;
 			return false;
 		}
 
 		// issue the search command
 		if (search_mode == true) {
-			ds18b20_write_byte(0xF0);   // NORMAL SEARCH
+			ds18b20_bus_write_byte(bus, 0xF0);   // NORMAL SEARCH
 		} else {
-			ds18b20_write_byte(0xEC);   // CONDITIONAL SEARCH
+			ds18b20_bus_write_byte(bus, 0xEC);   // CONDITIONAL SEARCH
 		}
 
 		// loop to do the search
 		do {
 			// read a bit and its complement
-			id_bit = ds18b20_read();
-			cmp_id_bit = ds18b20_read();
+			id_bit = ds18b20_bus_read(bus);
+			cmp_id_bit = ds18b20_bus_read(bus);
 
 			// check for no devices on 1-wire
 			if ((id_bit == 1) && (cmp_id_bit == 1)) {
@@ -393,12 +906,12 @@ bool search(uint8_t *newAddr, bool search_mode) {
 				} else {
 					// if this discrepancy if before the Last Discrepancy
 					// on a previous next then pick the same as last time
-					if (id_bit_number < LastDiscrepancy) {
-						search_direction = ((ROM_NO[rom_byte_number]
+					if (id_bit_number < bus->LastDiscrepancy) {
+						search_direction = ((bus->ROM_NO[rom_byte_number]
 								& rom_byte_mask) > 0);
 					} else {
 						// if equal to last pick 1, if not then pick 0
-						search_direction = (id_bit_number == LastDiscrepancy);
+						search_direction = (id_bit_number == bus->LastDiscrepancy);
 					}
 					// if 0 was picked then record its position in LastZero
 					if (search_direction == 0) {
@@ -406,19 +919,19 @@ bool search(uint8_t *newAddr, bool search_mode) {
 
 						// check for Last discrepancy in family
 						if (last_zero < 9)
-							LastFamilyDiscrepancy = last_zero;
+							bus->LastFamilyDiscrepancy = last_zero;
 					}
 				}
 
 				// set or clear the bit in the ROM byte rom_byte_number
 				// with mask rom_byte_mask
 				if (search_direction == 1)
-					ROM_NO[rom_byte_number] |= rom_byte_mask;
+					bus->ROM_NO[rom_byte_number] |= rom_byte_mask;
 				else
-					ROM_NO[rom_byte_number] &= ~rom_byte_mask;
+					bus->ROM_NO[rom_byte_number] &= ~rom_byte_mask;
 
 				// serial number search direction write bit
-				ds18b20_write(search_direction);
+				ds18b20_bus_write(bus, search_direction);
 
 				// increment the byte counter id_bit_number
 				// and shift the mask rom_byte_mask
@@ -436,28 +949,134 @@ bool search(uint8_t *newAddr, bool search_mode) {
 		// if the search was successful then
 		if (!(id_bit_number < 65)) {
 			// search successful so set LastDiscrepancy,LastDeviceFlag,search_result
-			LastDiscrepancy = last_zero;
+			bus->LastDiscrepancy = last_zero;
 
 			// check for last device
-			if (LastDiscrepancy == 0) {
-				LastDeviceFlag = true;
+			if (bus->LastDiscrepancy == 0) {
+				bus->LastDeviceFlag = true;
 			}
 			search_result = true;
 		}
 	}
 
 	// if no device found then reset counters so next 'search' will be like a first
-	if (!search_result || !ROM_NO[0]) {
-		devices=0;
-		LastDiscrepancy = 0;
-		LastDeviceFlag = false;
-		LastFamilyDiscrepancy = 0;
+	if (!search_result || !bus->ROM_NO[0]) {
+		bus->devices=0;
+		bus->LastDiscrepancy = 0;
+		bus->LastDeviceFlag = false;
+		bus->LastFamilyDiscrepancy = 0;
 		search_result = false;
 	} else {
 		for (int i = 0; i < 8; i++){
-			newAddr[i] = ROM_NO[i];
+			newAddr[i] = bus->ROM_NO[i];
 		}
-		devices++;
+		bus->devices++;
 	}
 	return search_result;
 }
+
+// Functions of the single bus api work on the bus set up by ds18b20_init().
+
+void ds18b20_init(int GPIO) {
+	ds18b20_bus_init(&legacy_bus, GPIO);
+}
+
+void ds18b20_write(char bit) {
+	ds18b20_bus_write(&legacy_bus, bit);
+}
+
+unsigned char ds18b20_read(void) {
+	return ds18b20_bus_read(&legacy_bus);
+}
+
+void ds18b20_write_byte(char data) {
+	ds18b20_bus_write_byte(&legacy_bus, data);
+}
+
+unsigned char ds18b20_read_byte(void) {
+	return ds18b20_bus_read_byte(&legacy_bus);
+}
+
+unsigned char ds18b20_reset(void) {
+	return ds18b20_bus_reset(&legacy_bus);
+}
+
+uint32_t ds18b20_criticalTime(void) {
+	return ds18b20_bus_criticalTime(&legacy_bus);
+}
+
+bool ds18b20_setResolution(const DeviceAddress tempSensorAddresses[], int numAddresses, uint8_t newResolution) {
+	return ds18b20_bus_setResolution(&legacy_bus, tempSensorAddresses, numAddresses, newResolution);
+}
+
+bool ds18b20_isConnected(const DeviceAddress *deviceAddress, uint8_t *scratchPad) {
+	return ds18b20_bus_isConnected(&legacy_bus, deviceAddress, scratchPad);
+}
+
+void ds18b20_writeScratchPad(const DeviceAddress *deviceAddress, const uint8_t *scratchPad) {
+	ds18b20_bus_writeScratchPad(&legacy_bus, deviceAddress, scratchPad);
+}
+
+bool ds18b20_readScratchPad(const DeviceAddress *deviceAddress, uint8_t *scratchPad) {
+	return ds18b20_bus_readScratchPad(&legacy_bus, deviceAddress, scratchPad);
+}
+
+void ds18b20_select(const DeviceAddress *address) {
+	ds18b20_bus_select(&legacy_bus, address);
+}
+
+bool isConversionComplete() {
+	return ds18b20_bus_isConversionComplete(&legacy_bus);
+}
+
+uint16_t millisToWaitForConversion() {
+	return ds18b20_bus_millisToWaitForConversion(&legacy_bus);
+}
+
+bool ds18b20_startConversion(TaskHandle_t task, uint32_t bits) {
+	return ds18b20_bus_startConversion(&legacy_bus, task, bits);
+}
+
+bool ds18b20_conversionPending(void) {
+	return ds18b20_bus_conversionPending(&legacy_bus);
+}
+
+void ds18b20_requestTemperatures() {
+	ds18b20_bus_requestTemperatures(&legacy_bus);
+}
+
+float ds18b20_getTempF(const DeviceAddress *deviceAddress) {
+	return ds18b20_bus_getTempF(&legacy_bus, deviceAddress);
+}
+
+float ds18b20_getTempC(const DeviceAddress *deviceAddress) {
+	return ds18b20_bus_getTempC(&legacy_bus, deviceAddress);
+}
+
+uint8_t ds18b20_getSensorResolution(const DeviceAddress *deviceAddress) {
+	return ds18b20_bus_getSensorResolution(&legacy_bus, deviceAddress);
+}
+
+const DeviceAddress *ds18b20_getPolicySensor(int index) {
+	return ds18b20_bus_getPolicySensor(&legacy_bus, index);
+}
+
+bool ds18b20_rosterChanged(void) {
+	return ds18b20_bus_rosterChanged(&legacy_bus);
+}
+
+void reset_search() {
+	ds18b20_bus_reset_search(&legacy_bus);
+}
+
+bool search(uint8_t *newAddr, bool search_mode) {
+	return ds18b20_bus_search(&legacy_bus, newAddr, search_mode);
+}
+
+int ds18b20_sampleChanged(const DeviceAddress sensors[], int numSensors, float temps[], int deadband) {
+	return ds18b20_bus_sampleChanged(&legacy_bus, sensors, numSensors, temps, deadband);
+}
+
+const struct ds18b20_slots *ds18b20_getSlots(void) {
+	return ds18b20_bus_slots(&legacy_bus);
+}
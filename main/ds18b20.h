@@ -13,6 +13,11 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <esp_system.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "nvs_flash.h"
 
 #ifndef DS18B20_H_  
 #define DS18B20_H_
@@ -20,6 +25,7 @@
 #define noInterrupts() portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;taskENTER_CRITICAL(&mux)
 #define interrupts() taskEXIT_CRITICAL(&mux)
 
+#define DS18B20_ROSTER_MAX 16
 #define DEVICE_DISCONNECTED_C -127
 #define DEVICE_DISCONNECTED_F -196.6
 #define DEVICE_DISCONNECTED_RAW -7040
@@ -29,6 +35,83 @@
 typedef uint8_t DeviceAddress[8];
 typedef uint8_t ScratchPad[9];
 
+// sensors found on a bus, kept in nvs
+struct ds18b20_roster
+{
+	uint8_t count;
+	DeviceAddress addr[DS18B20_ROSTER_MAX];
+	uint8_t crc;     // of the fields above
+};
+
+// resolution of one sensor's next conversion
+struct ds18b20_policy
+{
+	DeviceAddress addr;
+	uint8_t resolution;
+	uint8_t stable;      // readings in a row that changed slowly
+	int16_t last;        // 1/128 degrees
+	int64_t lastts;      // esp_timer time of last, 0 = no reading yet
+	uint8_t requested;   // by the last setResolution, 0 = none
+	bool alarmed;        // TH/TL hold a window around last
+};
+
+typedef struct ds18b20_bus ds18b20_bus_t;
+
+// Access to the wire, one bit or one byte lsb first
+struct ds18b20_bus_ops
+{
+	unsigned char (*reset)(ds18b20_bus_t *bus);   // 1 if a device answered
+	void (*write)(ds18b20_bus_t *bus, char bit);
+	unsigned char (*read)(ds18b20_bus_t *bus);
+	void (*write_byte)(ds18b20_bus_t *bus, char data);
+	unsigned char (*read_byte)(ds18b20_bus_t *bus);
+};
+
+// time slots used on a bus
+struct ds18b20_slots
+{
+	uint32_t resets;
+	uint32_t writes;
+	uint32_t reads;
+};
+
+// All state of one 1-Wire bus. Zero it before ds18b20_bus_init().
+struct ds18b20_bus
+{
+	int index;
+	uint8_t gpio;
+	int uart;                  // -1 when not on a uart
+	const struct ds18b20_bus_ops *ops;
+	void *ops_ctx;             // for plugged in ops
+	struct ds18b20_slots slots;
+	uint8_t bitResolution;     // of the most precise sensor
+	uint32_t critical_us;      // time with interrupts off
+	// search state
+	DeviceAddress ROM_NO;
+	uint8_t LastDiscrepancy;
+	uint8_t LastFamilyDiscrepancy;
+	bool LastDeviceFlag;
+	uint8_t devices;
+	// conversion in progress
+	esp_timer_handle_t conv_timer;
+	SemaphoreHandle_t conv_done;
+	TaskHandle_t conv_task;
+	uint32_t conv_bits;
+	volatile bool conv_pending;
+	struct ds18b20_roster roster;
+	bool roster_loaded;
+	bool roster_valid;
+	bool roster_changed;
+	int roster_replay;         // next roster address returned by search, -1 = search the bus
+	int64_t roster_scanned;     // time of the last search, or of loading a valid roster
+	bool roster_searched;      // bus searched since boot, roster no longer replayed
+	struct ds18b20_roster roster_candidate;   // other than the roster in the last scan
+	bool roster_pending;       // roster_candidate is valid
+	struct ds18b20_policy policies[DS18B20_ROSTER_MAX];
+	int policy_count;
+	uint8_t sample_cycles;     // alarm sampled cycles since every sensor was read
+};
+
 // Dow-CRC using polynomial X^8 + X^5 + X^4 + X^0
 // Tiny 2x16 entry CRC table created by Arjen Lentz
 // See http://lentz.com.au/blog/calculating-crc-with-a-tiny-32-entry-lookup-table
@@ -56,6 +139,8 @@ unsigned char ds18b20_read(void);
 void ds18b20_write_byte(char data);
 unsigned char ds18b20_read_byte(void);
 unsigned char ds18b20_reset(void);
+uint32_t ds18b20_criticalTime(void);
+const struct ds18b20_slots *ds18b20_getSlots(void);
 
 bool ds18b20_setResolution(const DeviceAddress tempSensorAddresses[], int numAddresses, uint8_t newResolution);
 bool ds18b20_isConnected(const DeviceAddress *deviceAddress, uint8_t *scratchPad);
@@ -67,14 +152,52 @@ bool ds18b20_isAllZeros(const uint8_t * const scratchPad);
 bool isConversionComplete();
 uint16_t millisToWaitForConversion();
 
+bool ds18b20_startConversion(TaskHandle_t task, uint32_t bits);
+bool ds18b20_conversionPending(void);
 void ds18b20_requestTemperatures();
 float ds18b20_getTempF(const DeviceAddress *deviceAddress);
 float ds18b20_getTempC(const DeviceAddress *deviceAddress);
 int16_t calculateTemperature(const DeviceAddress *deviceAddress, uint8_t* scratchPad);
 float ds18b20_get_temp(void);
 
+void ds18b20_setPrecisionZone(int low, int high);
+uint8_t ds18b20_getSensorResolution(const DeviceAddress *deviceAddress);
+const DeviceAddress *ds18b20_getPolicySensor(int index);
+void ds18b20_useRoster(nvs_handle nvsh);
+bool ds18b20_rosterChanged(void);
 void reset_search();
 bool search(uint8_t *newAddr, bool search_mode);
+int ds18b20_sampleChanged(const DeviceAddress sensors[], int numSensors, float temps[], int deadband);
+
+// Same as above on a bus of its own. Functions without the bus argument
+// use the bus set up by ds18b20_init().
+void ds18b20_bus_init(ds18b20_bus_t *bus, int GPIO);
+void ds18b20_bus_set_ops(ds18b20_bus_t *bus, const struct ds18b20_bus_ops *ops, void *ctx);
+const struct ds18b20_slots *ds18b20_bus_slots(ds18b20_bus_t *bus);
+void ds18b20_bus_write(ds18b20_bus_t *bus, char bit);
+unsigned char ds18b20_bus_read(ds18b20_bus_t *bus);
+void ds18b20_bus_write_byte(ds18b20_bus_t *bus, char data);
+unsigned char ds18b20_bus_read_byte(ds18b20_bus_t *bus);
+unsigned char ds18b20_bus_reset(ds18b20_bus_t *bus);
+uint32_t ds18b20_bus_criticalTime(ds18b20_bus_t *bus);
+bool ds18b20_bus_setResolution(ds18b20_bus_t *bus, const DeviceAddress tempSensorAddresses[], int numAddresses, uint8_t newResolution);
+bool ds18b20_bus_isConnected(ds18b20_bus_t *bus, const DeviceAddress *deviceAddress, uint8_t *scratchPad);
+void ds18b20_bus_writeScratchPad(ds18b20_bus_t *bus, const DeviceAddress *deviceAddress, const uint8_t *scratchPad);
+bool ds18b20_bus_readScratchPad(ds18b20_bus_t *bus, const DeviceAddress *deviceAddress, uint8_t *scratchPad);
+void ds18b20_bus_select(ds18b20_bus_t *bus, const DeviceAddress *address);
+bool ds18b20_bus_isConversionComplete(ds18b20_bus_t *bus);
+uint16_t ds18b20_bus_millisToWaitForConversion(ds18b20_bus_t *bus);
+bool ds18b20_bus_startConversion(ds18b20_bus_t *bus, TaskHandle_t task, uint32_t bits);
+bool ds18b20_bus_conversionPending(ds18b20_bus_t *bus);
+void ds18b20_bus_requestTemperatures(ds18b20_bus_t *bus);
+float ds18b20_bus_getTempF(ds18b20_bus_t *bus, const DeviceAddress *deviceAddress);
+float ds18b20_bus_getTempC(ds18b20_bus_t *bus, const DeviceAddress *deviceAddress);
+uint8_t ds18b20_bus_getSensorResolution(ds18b20_bus_t *bus, const DeviceAddress *deviceAddress);
+const DeviceAddress *ds18b20_bus_getPolicySensor(ds18b20_bus_t *bus, int index);
+bool ds18b20_bus_rosterChanged(ds18b20_bus_t *bus);
+void ds18b20_bus_reset_search(ds18b20_bus_t *bus);
+bool ds18b20_bus_search(ds18b20_bus_t *bus, uint8_t *newAddr, bool search_mode);
+int ds18b20_bus_sampleChanged(ds18b20_bus_t *bus, const DeviceAddress sensors[], int numSensors, float temps[], int deadband);
 
 /* *INDENT-OFF* */
 #ifdef __cplusplus
@@ -180,6 +180,38 @@ void flash_write_float(nvs_handle nvsh, char *name, float value)
     ESP_LOGI(TAG,"%s", (err != ESP_OK) ? "Failed!" : "Done");
 }
 
+// true if the blob was found and has exactly len bytes
+bool flash_read_blob(nvs_handle nvsh, char *name, void *value, size_t len)
+{
+    esp_err_t err;
+    size_t readlen = len;
+
+    err = nvs_get_blob(nvsh, name, value, &readlen);
+    switch (err) {
+        case ESP_OK:
+            if (readlen == len)
+                return true;
+            ESP_LOGI(TAG, "%s has %d bytes, expected %d", name, readlen, len);
+        break;
+
+        case ESP_ERR_NVS_NOT_FOUND:
+            ESP_LOGI(TAG, "%s is not initialized yet!", name);
+        break;
+
+        default :
+            ESP_LOGI(TAG, "Error (%d) when reading %s!", err, name);
+    }
+    return false;
+}
+
+void flash_write_blob(nvs_handle nvsh, char *name, const void *value, size_t len)
+{
+    esp_err_t err;
+
+    err = nvs_set_blob(nvsh, name, value, len);
+    if (err != ESP_OK) ESP_LOGD(TAG,"failed to write %s",name);
+}
+
 void flash_commitchanges(nvs_handle nvsh)
 {
     esp_err_t err;
@@ -14,6 +14,8 @@ extern char *flash_read_str(nvs_handle nvsh, char *name, char *def, int len);
 extern void flash_write_str(nvs_handle nvsh, char *name, char *value);
 extern float flash_read_float(nvs_handle nvsh, char *name, float def);
 extern void flash_write_float(nvs_handle nvsh, char *name, float value);
+extern bool flash_read_blob(nvs_handle nvsh, char *name, void *value, size_t len);
+extern void flash_write_blob(nvs_handle nvsh, char *name, const void *value, size_t len);
 extern void flash_commitchanges(nvs_handle nvsh);
 
 #endif
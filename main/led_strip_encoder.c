@@ -4,11 +4,22 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <stdlib.h>
+#include <string.h>
 #include "esp_check.h"
 #include "led_strip_encoder.h"
 
 static const char *TAG = "led_encoder";
 
+// WS2812B datasheet timing, checked by the decoder. Each high and low time
+// may be off by up to 150ns.
+#define WS2812_T0H_NS       400
+#define WS2812_T0L_NS       850
+#define WS2812_T1H_NS       800
+#define WS2812_T1L_NS       450
+#define WS2812_TOLERANCE_NS 150
+#define WS2812_RESET_NS     50000
+
 typedef struct {
     rmt_encoder_t base;
     rmt_encoder_t *bytes_encoder;
@@ -17,6 +28,92 @@ typedef struct {
     rmt_symbol_word_t reset_code;
 } rmt_led_strip_encoder_t;
 
+// different led strip might have its own timing requirements, following parameters are for WS2812
+static void led_strip_timing(const led_strip_encoder_config_t *config, rmt_symbol_word_t *bit0, rmt_symbol_word_t *bit1, rmt_symbol_word_t *reset)
+{
+    *bit0 = (rmt_symbol_word_t) {
+        .level0 = 1,
+        .duration0 = 0.3 * config->resolution / 1000000, // T0H=0.3us
+        .level1 = 0,
+        .duration1 = 0.9 * config->resolution / 1000000, // T0L=0.9us
+    };
+    *bit1 = (rmt_symbol_word_t) {
+        .level0 = 1,
+        .duration0 = 0.9 * config->resolution / 1000000, // T1H=0.9us
+        .level1 = 0,
+        .duration1 = 0.3 * config->resolution / 1000000, // T1L=0.3us
+    };
+    uint32_t reset_ticks = config->resolution / 1000000 * 50 / 2; // reset code duration defaults to 50us
+    *reset = (rmt_symbol_word_t) {
+        .level0 = 0,
+        .duration0 = reset_ticks,
+        .level1 = 0,
+        .duration1 = reset_ticks,
+    };
+}
+
+size_t led_strip_encode_symbols(const led_strip_encoder_config_t *config, const uint8_t *data, size_t data_size, rmt_symbol_word_t *symbols)
+{
+    rmt_symbol_word_t bit0, bit1, reset;
+    size_t n = 0;
+
+    led_strip_timing(config, &bit0, &bit1, &reset);
+    for (size_t i = 0; i < data_size; i++) {
+        for (uint8_t mask = 0x80; mask; mask >>= 1) { // msb first, like the bytes encoder
+            symbols[n++] = (data[i] & mask) ? bit1 : bit0;
+        }
+    }
+    symbols[n++] = reset;
+    return n;
+}
+
+static uint32_t led_strip_ticks_to_ns(const led_strip_encoder_config_t *config, uint32_t ticks)
+{
+    return (uint64_t) ticks * 1000000000 / config->resolution;
+}
+
+// high then low, both within the tolerance of the datasheet times
+static bool led_strip_bit_match(const led_strip_encoder_config_t *config, const rmt_symbol_word_t *s, int high_ns, int low_ns)
+{
+    return s->level0 == 1 && s->level1 == 0 &&
+           abs((int) led_strip_ticks_to_ns(config, s->duration0) - high_ns) <= WS2812_TOLERANCE_NS &&
+           abs((int) led_strip_ticks_to_ns(config, s->duration1) - low_ns) <= WS2812_TOLERANCE_NS;
+}
+
+// Checks against the datasheet, not led_strip_timing(), so that a wrong
+// encoder timing shows up too
+int led_strip_decode_symbols(const led_strip_encoder_config_t *config, const rmt_symbol_word_t *symbols, size_t num_symbols, uint8_t *data, size_t data_size)
+{
+    size_t bits = 0;
+
+    for (size_t i = 0; i < num_symbols; i++) {
+        const rmt_symbol_word_t *s = &symbols[i];
+        if (s->level0 == 0 && s->level1 == 0) {
+            // reset code ends the frame, it must be long enough to latch
+            if (led_strip_ticks_to_ns(config, s->duration0 + s->duration1) < WS2812_RESET_NS || bits % 8) {
+                ESP_LOGD(TAG, "bad reset code at symbol %d", (int) i);
+                return -1;
+            }
+            return bits / 8;
+        }
+        if (bits / 8 >= data_size) {
+            ESP_LOGD(TAG, "more than %d bytes", (int) data_size);
+            return -1;
+        }
+        if (led_strip_bit_match(config, s, WS2812_T1H_NS, WS2812_T1L_NS)) {
+            data[bits / 8] = (data[bits / 8] << 1) | 1;
+        } else if (led_strip_bit_match(config, s, WS2812_T0H_NS, WS2812_T0L_NS)) {
+            data[bits / 8] = data[bits / 8] << 1;
+        } else {
+            ESP_LOGD(TAG, "symbol %d is out of bit timing", (int) i);
+            return -1;
+        }
+        bits++;
+    }
+    ESP_LOGD(TAG, "no reset code");
+    return -1;
+}
+
 static size_t rmt_encode_led_strip(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
 {
     rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
@@ -81,33 +178,129 @@ esp_err_t rmt_new_led_strip_encoder(const led_strip_encoder_config_t *config, rm
     led_encoder->base.encode = rmt_encode_led_strip;
     led_encoder->base.del = rmt_del_led_strip_encoder;
     led_encoder->base.reset = rmt_led_strip_encoder_reset;
-    // different led strip might have its own timing requirements, following parameter is for WS2812
     rmt_bytes_encoder_config_t bytes_encoder_config = {
-        .bit0 = {
-            .level0 = 1,
-            .duration0 = 0.3 * config->resolution / 1000000, // T0H=0.3us
-            .level1 = 0,
-            .duration1 = 0.9 * config->resolution / 1000000, // T0L=0.9us
-        },
-        .bit1 = {
-            .level0 = 1,
-            .duration0 = 0.9 * config->resolution / 1000000, // T1H=0.9us
-            .level1 = 0,
-            .duration1 = 0.3 * config->resolution / 1000000, // T1L=0.3us
-        },
         .flags.msb_first = 1 // WS2812 transfer bit order: G7...G0R7...R0B7...B0
     };
+    led_strip_timing(config, &bytes_encoder_config.bit0, &bytes_encoder_config.bit1, &led_encoder->reset_code);
     ESP_GOTO_ON_ERROR(rmt_new_bytes_encoder(&bytes_encoder_config, &led_encoder->bytes_encoder), err, TAG, "create bytes encoder failed");
     rmt_copy_encoder_config_t copy_encoder_config = {};
     ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &led_encoder->copy_encoder), err, TAG, "create copy encoder failed");
 
-    uint32_t reset_ticks = config->resolution / 1000000 * 50 / 2; // reset code duration defaults to 50us
-    led_encoder->reset_code = (rmt_symbol_word_t) {
-        .level0 = 0,
-        .duration0 = reset_ticks,
-        .level1 = 0,
-        .duration1 = reset_ticks,
+    *ret_encoder = &led_encoder->base;
+    return ESP_OK;
+err:
+    if (led_encoder) {
+        if (led_encoder->bytes_encoder) {
+            rmt_del_encoder(led_encoder->bytes_encoder);
+        }
+        if (led_encoder->copy_encoder) {
+            rmt_del_encoder(led_encoder->copy_encoder);
+        }
+        free(led_encoder);
+    }
+    return ret;
+}
+
+typedef struct {
+    rmt_encoder_t base;
+    rmt_encoder_t *bytes_encoder;
+    rmt_encoder_t *copy_encoder;
+    int state;
+    size_t led;                 // led being sent
+    uint8_t pixel[3];           // its color from the palette
+    const uint8_t *palette;
+    rmt_symbol_word_t reset_code;
+} rmt_led_palette_encoder_t;
+
+// Each led is expanded from the palette and sent through the bytes encoder.
+// When the rmt memory gets full, the bytes encoder keeps its position in the
+// pixel and the same led is expanded again on the next call.
+static size_t rmt_encode_led_palette(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    rmt_led_palette_encoder_t *led_encoder = __containerof(encoder, rmt_led_palette_encoder_t, base);
+    rmt_encoder_handle_t bytes_encoder = led_encoder->bytes_encoder;
+    rmt_encoder_handle_t copy_encoder = led_encoder->copy_encoder;
+    const uint8_t *indexes = primary_data;
+    rmt_encode_state_t session_state = RMT_ENCODING_RESET;
+    rmt_encode_state_t state = RMT_ENCODING_RESET;
+    size_t encoded_symbols = 0;
+    switch (led_encoder->state) {
+    case 0: // send leds
+        while (led_encoder->led < data_size * 2) {
+            uint8_t index = indexes[led_encoder->led / 2];
+            index = (led_encoder->led & 1) ? index >> 4 : index & 0x0f;
+            memcpy(led_encoder->pixel, &led_encoder->palette[index * 3], 3);
+            encoded_symbols += bytes_encoder->encode(bytes_encoder, channel, led_encoder->pixel, 3, &session_state);
+            if (session_state & RMT_ENCODING_COMPLETE) {
+                led_encoder->led++;
+            }
+            if (session_state & RMT_ENCODING_MEM_FULL) {
+                state |= RMT_ENCODING_MEM_FULL;
+                goto out; // yield if there's no free space for encoding artifacts
+            }
+        }
+        led_encoder->led = 0;
+        led_encoder->state = 1;
+    // fall-through
+    case 1: // send reset code
+        encoded_symbols += copy_encoder->encode(copy_encoder, channel, &led_encoder->reset_code,
+                                                sizeof(led_encoder->reset_code), &session_state);
+        if (session_state & RMT_ENCODING_COMPLETE) {
+            led_encoder->state = RMT_ENCODING_RESET; // back to the initial encoding session
+            state |= RMT_ENCODING_COMPLETE;
+        }
+        if (session_state & RMT_ENCODING_MEM_FULL) {
+            state |= RMT_ENCODING_MEM_FULL;
+            goto out; // yield if there's no free space for encoding artifacts
+        }
+    }
+out:
+    *ret_state = state;
+    return encoded_symbols;
+}
+
+static esp_err_t rmt_del_led_palette_encoder(rmt_encoder_t *encoder)
+{
+    rmt_led_palette_encoder_t *led_encoder = __containerof(encoder, rmt_led_palette_encoder_t, base);
+    rmt_del_encoder(led_encoder->bytes_encoder);
+    rmt_del_encoder(led_encoder->copy_encoder);
+    free(led_encoder);
+    return ESP_OK;
+}
+
+static esp_err_t rmt_led_palette_encoder_reset(rmt_encoder_t *encoder)
+{
+    rmt_led_palette_encoder_t *led_encoder = __containerof(encoder, rmt_led_palette_encoder_t, base);
+    rmt_encoder_reset(led_encoder->bytes_encoder);
+    rmt_encoder_reset(led_encoder->copy_encoder);
+    led_encoder->state = RMT_ENCODING_RESET;
+    led_encoder->led = 0;
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_led_palette_encoder(const led_strip_palette_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    esp_err_t ret = ESP_OK;
+    rmt_led_palette_encoder_t *led_encoder = NULL;
+    ESP_GOTO_ON_FALSE(config && config->palette && ret_encoder, ESP_ERR_INVALID_ARG, err, TAG, "invalid argument");
+    led_encoder = rmt_alloc_encoder_mem(sizeof(rmt_led_palette_encoder_t));
+    ESP_GOTO_ON_FALSE(led_encoder, ESP_ERR_NO_MEM, err, TAG, "no mem for led palette encoder");
+    led_encoder->base.encode = rmt_encode_led_palette;
+    led_encoder->base.del = rmt_del_led_palette_encoder;
+    led_encoder->base.reset = rmt_led_palette_encoder_reset;
+    led_encoder->palette = config->palette;
+    led_encoder->led = 0;
+    led_encoder->state = RMT_ENCODING_RESET;
+    led_strip_encoder_config_t timing_config = {
+        .resolution = config->resolution,
     };
+    rmt_bytes_encoder_config_t bytes_encoder_config = {
+        .flags.msb_first = 1 // WS2812 transfer bit order: G7...G0R7...R0B7...B0
+    };
+    led_strip_timing(&timing_config, &bytes_encoder_config.bit0, &bytes_encoder_config.bit1, &led_encoder->reset_code);
+    ESP_GOTO_ON_ERROR(rmt_new_bytes_encoder(&bytes_encoder_config, &led_encoder->bytes_encoder), err, TAG, "create bytes encoder failed");
+    rmt_copy_encoder_config_t copy_encoder_config = {};
+    ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &led_encoder->copy_encoder), err, TAG, "create copy encoder failed");
     *ret_encoder = &led_encoder->base;
     return ESP_OK;
 err:
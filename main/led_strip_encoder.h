@@ -31,6 +31,60 @@ typedef struct {
  */
 esp_err_t rmt_new_led_strip_encoder(const led_strip_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder);
 
+/**
+ * @brief Type of led strip palette encoder configuration
+ */
+typedef struct {
+    uint32_t resolution;    /*!< Encoder resolution, in Hz */
+    const uint8_t *palette; /*!< 16 colors of 3 bytes in wire order, read while encoding */
+} led_strip_palette_encoder_config_t;
+
+/**
+ * @brief Create RMT encoder for LED strip pixels stored as 4 bit palette indexes
+ *
+ * Two leds in a byte, the first one in the low nibble. The palette is expanded
+ * to WS2812 bit symbols while encoding, so it must stay valid while sending.
+ *
+ * @param[in] config Encoder configuration
+ * @param[out] ret_encoder Returned encoder handle
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory when creating led palette encoder
+ *      - ESP_OK if creating encoder successfully
+ */
+esp_err_t rmt_new_led_palette_encoder(const led_strip_palette_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder);
+
+/**
+ * @brief Number of RMT symbols led_strip_encode_symbols() writes for data_size bytes, reset code included
+ */
+#define LED_STRIP_SYMBOLS(data_size) ((data_size) * 8 + 1)
+
+/**
+ * @brief Encode LED strip pixels into RMT symbols in memory, to be sent later with a copy encoder
+ *
+ * @param[in] config Encoder configuration
+ * @param[in] data Pixel bytes in wire order
+ * @param[in] data_size Number of bytes
+ * @param[out] symbols Buffer of LED_STRIP_SYMBOLS(data_size) symbols
+ * @return Number of symbols written
+ */
+size_t led_strip_encode_symbols(const led_strip_encoder_config_t *config, const uint8_t *data, size_t data_size, rmt_symbol_word_t *symbols);
+
+/**
+ * @brief Decode RMT symbols of a LED strip frame back to pixel bytes, checking the WS2812 timing
+ *
+ * Every bit must be within 150ns of the WS2812B datasheet T0H/T0L or T1H/T1L,
+ * and the frame must end with a reset code of at least 50us.
+ *
+ * @param[in] config Encoder configuration, resolution of the symbols
+ * @param[in] symbols Symbols to decode
+ * @param[in] num_symbols Number of symbols
+ * @param[out] data Decoded pixel bytes in wire order
+ * @param[in] data_size Size of the data buffer
+ * @return Number of bytes decoded, -1 if the timing is wrong or the data does not fit
+ */
+int led_strip_decode_symbols(const led_strip_encoder_config_t *config, const rmt_symbol_word_t *symbols, size_t num_symbols, uint8_t *data, size_t data_size);
+
 #ifdef __cplusplus
 }
 #endif
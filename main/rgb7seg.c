@@ -1,42 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
 #include <string.h>
+#include <math.h>
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "soc/soc_caps.h"
 #include "driver/rmt_tx.h"
+#include "driver/gptimer.h"
+#include "esp_timer.h"
+#include "esp_log.h"
 #include "led_strip_encoder.h"
 #include "rgb7seg.h"
 
 
-typedef struct color segment[2];
+// One led in the frame, bytes in the order they go to the wire. Colors are
+// converted once per digit, rendering only copies pixels.
+struct pixel
+{
+    uint8_t wire[3];
+};
 
-struct a7seg
+// With palette frames a led is a 4 bit index to a palette of wire order
+// colors, two leds in a byte. The encoder expands them while sending.
+#if CONFIG_RGB7SEG_PALETTE_FRAMES
+typedef uint8_t ledval;    // palette index, 0 is off
+#define PALETTE_SIZE        16
+#define FRAME_BYTES(leds)   (((leds) + 1) / 2)
+#else
+typedef struct pixel ledval;
+#define FRAME_BYTES(leds)   ((leds) * sizeof(struct pixel))
+#endif
+
+struct indicator
 {
-    segment a;
-    segment b;
-    segment c;
-    segment d;
-    segment e;
-    segment f;
-    segment g;
+    struct color c;
+    bool owncolor;        // if false, indicator has the same color as digits
+    bool blink;
 };
 
 
 #define RMT_LED_STRIP_RESOLUTION_HZ 10000000 // 10MHz resolution, 1 tick = 0.1us (led strip needs a high resolution)
-#define STRIP_LED_NUMBERS         58
+#define SEGMENTS                  7
+#define INDICATORS                2   // colon and decimal point leds after the digits
+#define BLINK_PERIOD_US           500000
+#define TX_DONE_TIMEOUT_MS        100
+#define ANIM_STEPS                64
+#define GAMMA                     2.2f
+#ifdef CONFIG_RGB7SEG_DITHER
+#define DITHER                    1
+#else
+#define DITHER                    0
+#endif
+// without a sync manager the channels are started one after another,
+// which still sends them in parallel
+#define RGB7SEG_SYNC_PANELS       (RGB7SEG_PANELS > 1 && SOC_RMT_SUPPORT_TX_SYNCHRO && CONFIG_RGB7SEG_OUTPUT_RMT)
+#if CONFIG_RGB7SEG_OUTPUT_CONSOLE
+#define DISPLAY_STACK             4096    // printf
+#else
+#define DISPLAY_STACK             2048
+#endif
+
+// display task notification bits
+#define NOTIFY_CMD                0x01
+#define NOTIFY_TXDONE             0x02
+#define NOTIFY_TICK               0x04
+#define NOTIFY_SCROLL             0x08
+#define NOTIFY_BLINK              0x10
+#define NOTIFY_REFRESH            0x20
+#define NOTIFY_SETTINGS           0x40
+
+
+// Display requests from all sources go through a one element mailbox to the
+// display task, which is the only one touching the strip. A newer request
+// overwrites an older one which was not yet taken.
+struct displaycmd
+{
+    char text[RGB7SEG_TEXT_LEN];
+    struct color colors[RGB7SEG_MAX_DIGITS];  // one for each digit
+    enum rgb7seg_source src;
+    enum rgb7seg_transition transition;
+    int ms;          // transition length
+    int steptime;    // marquee scroll step in ms, 0 = no scrolling
+    int repeat;      // marquee passes, 0 = forever
+    int64_t queued;  // esp_timer time when request was made
+};
 
+struct animation
+{
+    enum rgb7seg_transition transition;
+    int64_t start;
+    int64_t duration;  // in us
+    int skip;          // ticks to drop after a frame exceeded its cpu budget
+    uint8_t *from;
+    uint8_t *to;
+    // per digit loads, the last one is for the indicators
+    uint32_t from_load[RGB7SEG_MAX_DIGITS + 1];
+    uint32_t to_load[RGB7SEG_MAX_DIGITS + 1];
+    uint32_t from_total, to_total;
+};
+
+// Long texts are rendered once to a strip of digits, followed by an empty
+// window. Each scroll step copies a window of digits digits to the frame.
+struct marquee
+{
+    bool active;
+    int pos;
+    int len;     // scroll positions in one pass
+    int repeat;  // passes left, 0 = forever
+    char text[RGB7SEG_TEXT_LEN];
+    struct color colors[RGB7SEG_MAX_DIGITS];
+    uint8_t *strip;  // RGB7SEG_TEXT_LEN + 2 * digits digits
+    uint32_t load[RGB7SEG_TEXT_LEN + 2 * RGB7SEG_MAX_DIGITS];  // of each digit in the strip
+};
 
-static uint8_t led_strip_pixels[STRIP_LED_NUMBERS * 3];
-static struct a7seg *display = (struct a7seg *) led_strip_pixels;
+// Geometry comes from the layout at init. Digits follow each other in the
+// strip, colon and decimal point leds are after the last digit. Segment map
+// has the first led of each segment inside a digit, segment a first.
+static struct rgb7seg_layout layout;
+static uint8_t seg_map[SEGMENTS];
+static int digits;
+static int digit_leds;
+static int indicator_led;      // first indicator led
+static int strip_leds;
+static int frame_size;         // bytes
+static int marquee_size;       // bytes
 
+// Each panel is a display of its own, on its own rmt channel. Frames are
+// rendered to the back buffer, while rmt is sending the front buffer.
+// Buffers are swapped only when the previous transmission is done, so a frame
+// in the strip is never half written. The front buffer also holds the frame
+// latched in the strip, identical frames are not sent again.
+struct panel
+{
+    rmt_channel_handle_t chan;
+    rmt_encoder_handle_t encoder;
+    rmt_encoder_handle_t copy_encoder;  // for symbol cache entries
+    QueueHandle_t mailbox;
+    esp_timer_handle_t scroll_timer;
+    uint8_t *framebuffers[2];
+    int back;
+    uint8_t *pixels;        // back buffer
+    bool frame_pending;     // back buffer is waiting for rmt
+    bool front_valid;
+    bool scroll_due;
+    uint32_t load;          // sum of led values in the back buffer
+    uint32_t ma;            // estimated current of the front buffer
+    uint16_t scale;         // current limit of the front buffer, 256 = none
+    // request which produced the pending and the front buffer, for latency statistics
+    enum rgb7seg_source pending_src, inflight_src;
+    int64_t pending_queued, inflight_queued;
+    struct animation anim;
+    struct marquee marquee;
+    struct displaycmd current;  // static content on display, redrawn when indicators blink
+#if CONFIG_RGB7SEG_DITHER
+    uint8_t *dither_out[2];     // one is sent while the next one is prepared
+    uint8_t *dither_err;        // fraction left over from the previous refresh
+    int dither_next;
+    // request of the prepared frame and of the one on the wire, for latency statistics
+    enum rgb7seg_source prepared_src, wire_src;
+    int64_t prepared_queued, wire_queued;
+#endif
+};
+
+// Frames leave through an output backend. The rmt backend drives the strip,
+// the console backend prints the frames as colored digits, so that rendering
+// can be followed without leds. Send is called with tx_outstanding set, the
+// backend calls frame_sent() when the frame is out.
+struct output
+{
+    void (*init)(struct panel *p, int gpio);
+    void (*send)(struct panel *p, const uint8_t *pixels, bool cacheable);
+};
+
+static const struct output *output;
+
+// All panels are sent at the same time, a new round starts when every
+// channel of the previous one is done.
+static struct panel panels[RGB7SEG_PANELS];
+static bool tx_busy = false;
+static volatile int tx_outstanding;   // channels still sending
+static int64_t round_started;
+#if RGB7SEG_SYNC_PANELS
+static rmt_sync_manager_handle_t sync_manager;
+#endif
+
+static struct indicator indicators[RGB7SEG_INDICATOR_CNT];
+static bool blink_off = false;     // blinking indicators are dark during this half period
+static gptimer_handle_t blink_timer;
+static esp_timer_handle_t anim_timer;
+static uint16_t fade_lut[ANIM_STEPS + 1];   // eased 0..256 weights
+static uint16_t pulse_lut[ANIM_STEPS + 1];  // brightness 256..64..256
+// palette value -> led value, gamma correction and brightness in one table
+static uint8_t level_lut[256];
+#if CONFIG_RGB7SEG_DITHER
+// Frames keep the colors without brightness. The refresh engine sends them
+// again at a fixed rate, the led value has 8 fraction bits here and the
+// fraction is carried from one refresh to the next (sigma-delta).
+static uint16_t level16_lut[256];
+static esp_timer_handle_t refresh_timer;
+static int64_t dither_busy_us;      // cpu time of refreshes since dither_since
+static int64_t dither_since;
+#define LEVEL(v)  (v)
+#define LOAD(v)   level_lut[v]
+#else
+#define LEVEL(v)  level_lut[v]
+#define LOAD(v)   (v)
+#endif
+static const ledval led_off;
+#if CONFIG_RGB7SEG_PALETTE_FRAMES
+static struct color palette_colors[PALETTE_SIZE];
+static uint8_t palette[PALETTE_SIZE * sizeof(struct pixel)];  // read by the encoder
+static uint16_t palette_load[PALETTE_SIZE];
+static int palette_used = 1;
+#endif
+// Static frames are encoded to rmt symbols once and replayed with the copy
+// encoder. Animation and marquee frames go through the led strip encoder,
+// they would only push out the frames which really repeat.
+struct symcache_entry
+{
+    uint32_t hash;
+    uint32_t used;        // lru stamp, 0 is an empty entry
+    uint8_t *pixels;
+    rmt_symbol_word_t *symbols;
+};
+
+static struct symcache_entry *symcache;
+static int symcache_entries;
+#if CONFIG_RGB7SEG_VERIFY_SYMBOLS
+static uint8_t *symcache_check;  // decoded symbols of a new entry
+#endif
+static uint32_t symcache_clock;
+static uint32_t symcache_round;  // clock at the start of the transmission round
+
+static TaskHandle_t display_task_handle;
+// settings are posted like display requests, the luts and the palette
+// belong to the display task
+static QueueHandle_t brightness_mailbox;
+static QueueHandle_t indicator_mailbox[RGB7SEG_INDICATOR_CNT];
+static struct rgb7seg_stats stats;
+static const char *TAG = "rgb7seg";
+
+
+static const int panel_gpios[] =
+{
+    CONFIG_LEDSTRIP_GPIO,
+#if RGB7SEG_PANELS > 1
+    CONFIG_RGB7SEG_PANEL1_GPIO,
+#endif
+#if RGB7SEG_PANELS > 2
+    CONFIG_RGB7SEG_PANEL2_GPIO,
+#endif
+#if RGB7SEG_PANELS > 3
+    CONFIG_RGB7SEG_PANEL3_GPIO,
+#endif
+};
 
-static rmt_channel_handle_t led_chan = NULL;
 static rmt_tx_channel_config_t tx_chan_config = 
 {
         .clk_src = RMT_CLK_SRC_DEFAULT, // select source clock
-        .gpio_num = CONFIG_LEDSTRIP_GPIO,
         .mem_block_symbols = 64, // increase the block size can make the LED less flickering
         .resolution_hz = RMT_LED_STRIP_RESOLUTION_HZ,
-        .trans_queue_depth = 4, // set the number of transactions that can be pending in the background
+        .trans_queue_depth = 1, // only the front buffer is in flight, next frame waits in the back buffer
 };
-static rmt_encoder_handle_t led_encoder = NULL;
 static led_strip_encoder_config_t encoder_config = 
 {
     .resolution = RMT_LED_STRIP_RESOLUTION_HZ,
@@ -49,208 +276,1488 @@ static rmt_transmit_config_t tx_config =
 
 
 
-#define SET_SEGMENT(num,seg,color)  display[num].seg[0]=display[num].seg[1]=color
+// segment bits, bit 0 is segment a
+#define SEG_A 0x01
+#define SEG_B 0x02
+#define SEG_C 0x04
+#define SEG_D 0x08
+#define SEG_E 0x10
+#define SEG_F 0x20
+#define SEG_G 0x40
+
+// 7 segment font, indexed by ascii code. Characters which can not be
+// shown with 7 segments are left blank.
+static const uint8_t glyphs[128] =
+{
+    ['0'] = SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F,
+    ['1'] = SEG_B | SEG_C,
+    ['2'] = SEG_A | SEG_B | SEG_G | SEG_E | SEG_D,
+    ['3'] = SEG_A | SEG_B | SEG_G | SEG_C | SEG_D,
+    ['4'] = SEG_F | SEG_B | SEG_G | SEG_C,
+    ['5'] = SEG_A | SEG_F | SEG_G | SEG_C | SEG_D,
+    ['6'] = SEG_A | SEG_F | SEG_E | SEG_G | SEG_C | SEG_D,
+    ['7'] = SEG_A | SEG_B | SEG_C,
+    ['8'] = SEG_A | SEG_B | SEG_C | SEG_D | SEG_E | SEG_F | SEG_G,
+    ['9'] = SEG_A | SEG_B | SEG_C | SEG_D | SEG_F | SEG_G,
+
+    ['A'] = SEG_A | SEG_B | SEG_C | SEG_E | SEG_F | SEG_G,
+    ['a'] = SEG_A | SEG_B | SEG_C | SEG_E | SEG_F | SEG_G,
+    ['B'] = SEG_C | SEG_D | SEG_E | SEG_F | SEG_G,
+    ['b'] = SEG_C | SEG_D | SEG_E | SEG_F | SEG_G,
+    ['C'] = SEG_A | SEG_D | SEG_E | SEG_F,
+    ['c'] = SEG_D | SEG_E | SEG_G,
+    ['D'] = SEG_B | SEG_C | SEG_D | SEG_E | SEG_G,
+    ['d'] = SEG_B | SEG_C | SEG_D | SEG_E | SEG_G,
+    ['E'] = SEG_A | SEG_D | SEG_E | SEG_F | SEG_G,
+    ['e'] = SEG_A | SEG_D | SEG_E | SEG_F | SEG_G,
+    ['F'] = SEG_A | SEG_E | SEG_F | SEG_G,
+    ['f'] = SEG_A | SEG_E | SEG_F | SEG_G,
+    ['G'] = SEG_A | SEG_C | SEG_D | SEG_E | SEG_F,
+    ['g'] = SEG_A | SEG_C | SEG_D | SEG_E | SEG_F,
+    ['H'] = SEG_B | SEG_C | SEG_E | SEG_F | SEG_G,
+    ['h'] = SEG_C | SEG_E | SEG_F | SEG_G,
+    ['I'] = SEG_B | SEG_C,
+    ['i'] = SEG_B | SEG_C,
+    ['J'] = SEG_B | SEG_C | SEG_D | SEG_E,
+    ['j'] = SEG_B | SEG_C | SEG_D | SEG_E,
+    ['L'] = SEG_D | SEG_E | SEG_F,
+    ['l'] = SEG_D | SEG_E | SEG_F,
+    ['N'] = SEG_C | SEG_E | SEG_G,
+    ['n'] = SEG_C | SEG_E | SEG_G,
+    ['O'] = SEG_C | SEG_D | SEG_E | SEG_G,
+    ['o'] = SEG_C | SEG_D | SEG_E | SEG_G,
+    ['P'] = SEG_A | SEG_B | SEG_E | SEG_F | SEG_G,
+    ['p'] = SEG_A | SEG_B | SEG_E | SEG_F | SEG_G,
+    ['Q'] = SEG_A | SEG_B | SEG_C | SEG_F | SEG_G,
+    ['q'] = SEG_A | SEG_B | SEG_C | SEG_F | SEG_G,
+    ['R'] = SEG_E | SEG_G,
+    ['r'] = SEG_E | SEG_G,
+    ['S'] = SEG_A | SEG_F | SEG_G | SEG_C | SEG_D,
+    ['s'] = SEG_A | SEG_F | SEG_G | SEG_C | SEG_D,
+    ['T'] = SEG_D | SEG_E | SEG_F | SEG_G,
+    ['t'] = SEG_D | SEG_E | SEG_F | SEG_G,
+    ['U'] = SEG_B | SEG_C | SEG_D | SEG_E | SEG_F,
+    ['u'] = SEG_C | SEG_D | SEG_E,
+    ['Y'] = SEG_B | SEG_C | SEG_D | SEG_F | SEG_G,
+    ['y'] = SEG_B | SEG_C | SEG_D | SEG_F | SEG_G,
+
+    ['-'] = SEG_G,
+    ['_'] = SEG_D,
+    ['='] = SEG_D | SEG_G,
+};
+
+// bytes above ascii, like the utf-8 degree sign, are left blank
+static inline uint8_t glyph(char ch)
+{
+    return ((uint8_t) ch < sizeof(glyphs)) ? glyphs[(uint8_t) ch] : 0;
+}
+
+
+// Current is estimated from the sum of led values on the wire. Loads are
+// added up while the frame is rendered, not by reading it back.
+static inline uint32_t pixel_load(ledval v)
+{
+#if CONFIG_RGB7SEG_PALETTE_FRAMES
+    return palette_load[v];
+#else
+    return LOAD(v.wire[0]) + LOAD(v.wire[1]) + LOAD(v.wire[2]);
+#endif
+}
+
+// load of leds already in a frame, used only when an animation starts
+static uint32_t leds_load(const uint8_t *pixels, int first, int n)
+{
+    uint32_t load = 0;
 
+    for (int led = first; led < first + n; led++)
+    {
+#if CONFIG_RGB7SEG_PALETTE_FRAMES
+        uint8_t v = pixels[led / 2];
+        load += palette_load[(led & 1) ? v >> 4 : v & 0x0f];
+#else
+        load += pixel_load(((const struct pixel *) pixels)[led]);
+#endif
+    }
+    return load;
+}
 
-static void set_7seg(char *str, struct color c)
+static inline void put_led(uint8_t *pixels, int led, ledval v)
 {
-    memset(led_strip_pixels, 0, sizeof(led_strip_pixels));
-    for (int i=0; i<strlen(str);i++)
+#if CONFIG_RGB7SEG_PALETTE_FRAMES
+    uint8_t *p = &pixels[led / 2];
+    *p = (led & 1) ? (*p & 0x0f) | (v << 4) : (*p & 0xf0) | v;
+#else
+    ((struct pixel *) pixels)[led] = v;
+#endif
+}
+
+static void copy_leds(uint8_t *dst, int to, const uint8_t *src, int from, int n)
+{
+#if CONFIG_RGB7SEG_PALETTE_FRAMES
+    if (((to | from | n) & 1) == 0)
+    {
+        memcpy(&dst[to / 2], &src[from / 2], n / 2);
+        return;
+    }
+    for (int i = 0; i < n; i++, from++)
     {
-        if (i==4) break;
+        uint8_t v = src[from / 2];
+        put_led(dst, to + i, (from & 1) ? v >> 4 : v & 0x0f);
+    }
+#else
+    memcpy(&dst[to * sizeof(struct pixel)], &src[from * sizeof(struct pixel)], n * sizeof(struct pixel));
+#endif
+}
+
+// sets the segments of one digit, bit 0 of mask is segment a. Returns the load.
+static uint32_t blit_7seg(uint8_t *pixels, int digit, uint8_t mask, ledval c)
+{
+    int first = digit * digit_leds;
+    uint32_t load = __builtin_popcount(mask) * layout.segleds * pixel_load(c);
 
-        switch (str[i])
+    for (int s = 0; mask; s++, mask >>= 1)
+    {
+        if (mask & 1)
         {
-            case '1':
-            case 'I':
-            case 'i':
-                SET_SEGMENT(i,b,c);
-                SET_SEGMENT(i,c,c);
-            break;
+            int led = first + seg_map[s];
+            for (int k = 0; k < layout.segleds; k++)
+            {
+                put_led(pixels, led + k, c);
+            }
+        }
+    }
+    return load;
+}
 
-            case '2':
-                SET_SEGMENT(i,a,c);
-                SET_SEGMENT(i,b,c);
-                SET_SEGMENT(i,g,c);
-                SET_SEGMENT(i,e,c);
-                SET_SEGMENT(i,d,c);
-            break;
-                
-            case '3':
-                SET_SEGMENT(i,a,c);
-                SET_SEGMENT(i,b,c);
-                SET_SEGMENT(i,g,c);
-                SET_SEGMENT(i,c,c);
-                SET_SEGMENT(i,d,c);
-            break;
 
-            case '4':
-                SET_SEGMENT(i,f,c);
-                SET_SEGMENT(i,b,c);
-                SET_SEGMENT(i,g,c);
-                SET_SEGMENT(i,c,c);
-            break;
+// brightness, gamma and strip color order
+static struct pixel wire_color(struct color c)
+{
+    struct pixel p;
 
-            case '5':
-            case 's':
-            case 'S':
-                SET_SEGMENT(i,a,c);
-                SET_SEGMENT(i,f,c);
-                SET_SEGMENT(i,g,c);
-                SET_SEGMENT(i,c,c);
-                SET_SEGMENT(i,d,c);
-            break;
+#if CONFIG_RGB7SEG_COLOR_ORDER_GRB
+    p.wire[0] = LEVEL(c.g);
+    p.wire[1] = LEVEL(c.r);
+    p.wire[2] = LEVEL(c.b);
+#elif CONFIG_RGB7SEG_COLOR_ORDER_BRG
+    p.wire[0] = LEVEL(c.b);
+    p.wire[1] = LEVEL(c.r);
+    p.wire[2] = LEVEL(c.g);
+#else
+    p.wire[0] = LEVEL(c.r);
+    p.wire[1] = LEVEL(c.g);
+    p.wire[2] = LEVEL(c.b);
+#endif
+    return p;
+}
 
-            case '6':
-                SET_SEGMENT(i,a,c);
-                SET_SEGMENT(i,f,c);
-                SET_SEGMENT(i,e,c);
-                SET_SEGMENT(i,g,c);
-                SET_SEGMENT(i,c,c);
-                SET_SEGMENT(i,d,c);
-            break;
+#if CONFIG_RGB7SEG_PALETTE_FRAMES
+// Colors are added to the palette when first used. When it is full,
+// the nearest color is taken until the palette is emptied for a new text.
+static ledval led_color(struct color c)
+{
+    int best = 1;
+    int bestdist = INT32_MAX;
 
-            case '7':
-                SET_SEGMENT(i,a,c);
-                SET_SEGMENT(i,b,c);
-                SET_SEGMENT(i,c,c);
-            break;
+    for (int i = 1; i < palette_used; i++)
+    {
+        struct color *p = &palette_colors[i];
+        int dr = p->r - c.r, dg = p->g - c.g, db = p->b - c.b;
+        int dist = dr * dr + dg * dg + db * db;
 
-            case '8':
-                SET_SEGMENT(i,a,c);
-                SET_SEGMENT(i,b,c);
-                SET_SEGMENT(i,c,c);
-                SET_SEGMENT(i,d,c);
-                SET_SEGMENT(i,e,c);
-                SET_SEGMENT(i,f,c);
-                SET_SEGMENT(i,g,c);
-            break;
+        if (dist < bestdist)
+        {
+            best = i;
+            bestdist = dist;
+        }
+    }
+    if (bestdist == 0 || palette_used == PALETTE_SIZE)
+        return best;
 
-            case '9':
-                SET_SEGMENT(i,a,c);
-                SET_SEGMENT(i,b,c);
-                SET_SEGMENT(i,c,c);
-                SET_SEGMENT(i,d,c);
-                SET_SEGMENT(i,f,c);
-                SET_SEGMENT(i,g,c);
-            break;
+    palette_colors[palette_used] = c;
+    struct pixel wire = wire_color(c);
+    memcpy(&palette[palette_used * sizeof(struct pixel)], wire.wire, sizeof(struct pixel));
+    palette_load[palette_used] = wire.wire[0] + wire.wire[1] + wire.wire[2];
+    return palette_used++;
+}
+#else
+static ledval led_color(struct color c)
+{
+    return wire_color(c);
+}
+#endif
 
-            case '0':
-                SET_SEGMENT(i,a,c);
-                SET_SEGMENT(i,b,c);
-                SET_SEGMENT(i,c,c);
-                SET_SEGMENT(i,d,c);
-                SET_SEGMENT(i,e,c);
-                SET_SEGMENT(i,f,c);
-            break;
 
-            case 'q':
-            case 'Q':
-                SET_SEGMENT(i,a,c);
-                SET_SEGMENT(i,b,c);
-                SET_SEGMENT(i,c,c);
-                SET_SEGMENT(i,f,c);
-                SET_SEGMENT(i,g,c);
-            break;
+static uint32_t set_indicator(uint8_t *pixels, enum rgb7seg_indicator which, ledval digitcolor)
+{
+    struct indicator *ind = &indicators[which];
+    ledval v;
 
-            case 'A':
-            case 'a':
-                SET_SEGMENT(i,a,c);
-                SET_SEGMENT(i,b,c);
-                SET_SEGMENT(i,c,c);
-                SET_SEGMENT(i,g,c);
-                SET_SEGMENT(i,e,c);
-                SET_SEGMENT(i,f,c);
-            break;
+    if (ind->blink && blink_off)
+        return 0;
+    v = ind->owncolor ? led_color(ind->c) : digitcolor;
+    put_led(pixels, indicator_led + which, v);
+    return pixel_load(v);
+}
 
-           case 'b':
-           case 'B':
-                SET_SEGMENT(i,c,c);
-                SET_SEGMENT(i,d,c);
-                SET_SEGMENT(i,e,c);
-                SET_SEGMENT(i,f,c);
-                SET_SEGMENT(i,g,c);
-            break;
 
-            case '-':
-                SET_SEGMENT(i,g,c);
-            break;
+// ':' lights the colon and '.' the decimal point, they do not take a digit.
+// Indicators get the color of the digit before them. Load of each digit goes
+// to load[], indicators to load[digits], returns the total.
+static uint32_t set_7seg(uint8_t *pixels, char *str, const struct color *colors, uint32_t *load)
+{
+    ledval c = led_color(colors[0]);
+    uint32_t total = 0;
 
-            case 'O':
-            case 'o':
-                SET_SEGMENT(i,g,c);
-                SET_SEGMENT(i,c,c);
-                SET_SEGMENT(i,d,c);
-                SET_SEGMENT(i,e,c);
+    memset(pixels, 0, frame_size);
+    memset(load, 0, (digits + 1) * sizeof(uint32_t));
+    for (int i=0; i<digits && *str; str++)
+    {
+        switch (*str)
+        {
+            case ':':
+                load[digits] += set_indicator(pixels, RGB7SEG_COLON, c);
             break;
 
-            case 'E':
-                SET_SEGMENT(i,a,c);
-                SET_SEGMENT(i,d,c);
-                SET_SEGMENT(i,e,c);
-                SET_SEGMENT(i,f,c);
+            case '.':
+                load[digits] += set_indicator(pixels, RGB7SEG_DP, c);
             break;
 
-            case 'p':
-            case 'P':
-                SET_SEGMENT(i,a,c);
-                SET_SEGMENT(i,b,c);
-                SET_SEGMENT(i,g,c);
-                SET_SEGMENT(i,e,c);
-                SET_SEGMENT(i,f,c);
+            default:
+                c = led_color(colors[i]);
+                load[i] = blit_7seg(pixels, i, glyph(*str), c);
+                total += load[i++];
             break;
+        }
+    }
+    return total + load[digits];
+}
 
-            case 'f':
-            case 'F':
-                SET_SEGMENT(i,a,c);
-                SET_SEGMENT(i,g,c);
-                SET_SEGMENT(i,e,c);
-                SET_SEGMENT(i,f,c);
-            break;
+// digit positions the text takes, like in set_7seg()
+int rgb7seg_text_digits(const char *text)
+{
+    int n = 0;
 
-            case 't':
-            case 'T':
-                SET_SEGMENT(i,d,c);
-                SET_SEGMENT(i,g,c);
-                SET_SEGMENT(i,e,c);
-                SET_SEGMENT(i,f,c);
-            break;
+    for (; *text; text++)
+    {
+        if (*text != ':' && *text != '.')
+            n++;
+    }
+    return n;
+}
 
-            case 'l':
-            case 'L':
-                SET_SEGMENT(i,d,c);
-                SET_SEGMENT(i,e,c);
-                SET_SEGMENT(i,f,c);
-            break;
 
-            case 'n':
-            case 'N':
-                SET_SEGMENT(i,c,c);
-                SET_SEGMENT(i,e,c);
-                SET_SEGMENT(i,g,c);
-            break;
+static void apply_brightness(uint8_t brightness)
+{
+    for (int i = 0; i < 256; i++)
+    {
+        uint32_t gamma = 255.0f * powf(i / 255.0f, GAMMA) + 0.5f;
+        level_lut[i] = (gamma * brightness + 127) / 255;
+#if CONFIG_RGB7SEG_DITHER
+        level16_lut[i] = 256.0f * powf(i / 255.0f, GAMMA) * brightness + 0.5f;
+#endif
+    }
+#if CONFIG_RGB7SEG_PALETTE_FRAMES
+    for (int i = 1; i < palette_used; i++)
+    {
+        struct pixel wire = wire_color(palette_colors[i]);
+        memcpy(&palette[i * sizeof(struct pixel)], wire.wire, sizeof(struct pixel));
+        palette_load[i] = wire.wire[0] + wire.wire[1] + wire.wire[2];
+    }
+#endif
+}
 
-            case 'r':
-            case 'R':
-                SET_SEGMENT(i,e,c);
-                SET_SEGMENT(i,g,c);
-            break;
 
-            default:
-            break;    
+void rgb7seg_set_brightness(uint8_t brightness)
+{
+    xQueueOverwrite(brightness_mailbox, &brightness);
+    xTaskNotify(display_task_handle, NOTIFY_SETTINGS, eSetBits);
+}
+
+
+static void init_animation_tables(void)
+{
+    // smoothstep 3x^2 - 2x^3, x and result scaled to 0..256
+    for (int i = 0; i <= ANIM_STEPS; i++)
+    {
+        int32_t x = i * 256 / ANIM_STEPS;
+        fade_lut[i] = (3 * x * x * 256 - 2 * x * x * x) >> 16;
+    }
+    // brightness goes down to 1/4 and back up
+    for (int i = 0; i <= ANIM_STEPS; i++)
+    {
+        if (i <= ANIM_STEPS / 2)
+            pulse_lut[i] = 256 - 192 * fade_lut[2 * i] / 256;
+        else
+            pulse_lut[i] = 64 + 192 * fade_lut[2 * i - ANIM_STEPS] / 256;
+    }
+}
+
+// renders one step, returns the load of the frame. Blended loads are taken
+// from the loads of the two frames.
+static uint32_t animation_frame(struct panel *p, uint8_t *pixels, int step)
+{
+    uint32_t w;
+    uint32_t load = 0;
+
+    switch (p->anim.transition)
+    {
+        case RGB7SEG_FADE:
+            w = fade_lut[step];
+            for (int i = 0; i < frame_size; i++)
+            {
+                pixels[i] = (p->anim.from[i] * (256 - w) + p->anim.to[i] * w) >> 8;
+            }
+            load = (p->anim.from_total * (256 - w) + p->anim.to_total * w) >> 8;
+        break;
+
+        case RGB7SEG_SLIDE:
+        {
+            // old digits move out to the left, new ones come in from the right
+            int offset = (fade_lut[step] * digits + 128) >> 8;
+
+            for (int i = 0; i < digits; i++)
+            {
+                int k = i + offset;
+                if (k < digits)
+                {
+                    copy_leds(pixels, i * digit_leds, p->anim.from, k * digit_leds, digit_leds);
+                    load += p->anim.from_load[k];
+                }
+                else
+                {
+                    copy_leds(pixels, i * digit_leds, p->anim.to, (k - digits) * digit_leds, digit_leds);
+                    load += p->anim.to_load[k - digits];
+                }
+            }
+            copy_leds(pixels, indicator_led, p->anim.to, indicator_led, INDICATORS);
+            load += p->anim.to_load[digits];
+        }
+        break;
+
+        case RGB7SEG_PULSE:
+            w = pulse_lut[step];
+            for (int i = 0; i < frame_size; i++)
+            {
+                pixels[i] = (p->anim.to[i] * w) >> 8;
+            }
+            load = (p->anim.to_total * w) >> 8;
+        break;
+
+        default:
+            memcpy(pixels, p->anim.to, frame_size);
+            load = p->anim.to_total;
+        break;
+    }
+    return load;
+}
+
+// animation timer runs while any panel has an animation
+static void animation_stop(struct panel *p)
+{
+    if (p->anim.transition != RGB7SEG_NONE)
+    {
+        p->anim.transition = RGB7SEG_NONE;
+        for (int i = 0; i < RGB7SEG_PANELS; i++)
+        {
+            if (panels[i].anim.transition != RGB7SEG_NONE)
+                return;
+        }
+        esp_timer_stop(anim_timer);
+    }
+}
+
+static void animation_start(struct panel *p, struct displaycmd *cmd)
+{
+    animation_stop(p);
+    if (p->front_valid)
+        memcpy(p->anim.from, p->framebuffers[p->back ^ 1], frame_size);
+    else
+        memset(p->anim.from, 0, frame_size);
+    p->anim.from_total = 0;
+    for (int i = 0; i <= digits; i++)
+    {
+        int n = (i < digits) ? digit_leds : INDICATORS;
+        p->anim.from_load[i] = leds_load(p->anim.from, i * digit_leds, n);
+        p->anim.from_total += p->anim.from_load[i];
+    }
+    p->anim.to_total = set_7seg(p->anim.to, cmd->text, cmd->colors, p->anim.to_load);
+    p->anim.transition = cmd->transition;
+    p->anim.start = esp_timer_get_time();
+    p->anim.duration = (cmd->ms > 0) ? cmd->ms * 1000LL : 1;
+    p->anim.skip = 0;
+    if (!esp_timer_is_active(anim_timer))
+        esp_timer_start_periodic(anim_timer, 1000000 / CONFIG_RGB7SEG_ANIMATION_FPS);
+}
+
+// renders next animation frame to the back buffer. Frames are dropped when the
+// previous one is still on the wire or the last one took more than its cpu budget,
+// the animation keeps its speed because the step is taken from the elapsed time.
+static void animation_tick(struct panel *p)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t cost;
+    int step;
+
+    if (p->anim.transition == RGB7SEG_NONE)
+        return;
+
+    if (p->anim.skip > 0 || p->frame_pending || (tx_busy && !DITHER))
+    {
+        if (p->anim.skip > 0) p->anim.skip--;
+        stats.animdropped++;
+        return;
+    }
+
+    step = (now - p->anim.start) * ANIM_STEPS / p->anim.duration;
+    if (step >= ANIM_STEPS)
+    {
+        memcpy(p->pixels, p->anim.to, frame_size);
+        p->load = p->anim.to_total;
+        animation_stop(p);
+    }
+    else
+    {
+        p->load = animation_frame(p, p->pixels, step);
+    }
+    p->frame_pending = true;
+    stats.animframes++;
+
+    cost = esp_timer_get_time() - now;
+    if (cost > CONFIG_RGB7SEG_FRAME_BUDGET_US)
+    {
+        p->anim.skip = cost / CONFIG_RGB7SEG_FRAME_BUDGET_US;
+    }
+}
+
+static void animation_timer_cb(void *arg)
+{
+    xTaskNotify(display_task_handle, NOTIFY_TICK, eSetBits);
+}
+
+static void marquee_stop(struct panel *p)
+{
+    if (p->marquee.active)
+    {
+        esp_timer_stop(p->scroll_timer);
+        p->marquee.active = false;
+    }
+}
+
+// Renders the text of the marquee to its strip. The digit colors are
+// stretched along the text, so a gradient runs from its first to its last
+// digit.
+static void marquee_render(struct panel *p)
+{
+    ledval c[RGB7SEG_MAX_DIGITS];
+    int n = rgb7seg_text_digits(p->marquee.text);
+    int len = 0;
+
+    for (int i = 0; i < digits; i++)
+    {
+        c[i] = led_color(p->marquee.colors[i]);
+    }
+    memset(p->marquee.strip, 0, marquee_size);
+    for (char *t = p->marquee.text; *t; t++)
+    {
+        if (*t != ':' && *t != '.')
+        {
+            p->marquee.load[len] = blit_7seg(p->marquee.strip, len, glyph(*t), c[len * digits / n]);
+            len++;
+        }
+    }
+    memset(&p->marquee.load[len], 0, 2 * digits * sizeof(uint32_t));
+    p->marquee.len = len + digits;
+}
+
+static void marquee_start(struct panel *p, struct displaycmd *cmd)
+{
+    marquee_stop(p);
+    strcpy(p->marquee.text, cmd->text);
+    memcpy(p->marquee.colors, cmd->colors, sizeof(p->marquee.colors));
+    marquee_render(p);
+    p->marquee.pos = 0;
+    p->marquee.repeat = cmd->repeat;
+    p->marquee.active = true;
+    esp_timer_start_periodic(p->scroll_timer, cmd->steptime * 1000LL);
+}
+
+// copies the current window to the back buffer. Back buffer is never on the wire,
+// so a pending frame can be overwritten.
+static void marquee_step(struct panel *p)
+{
+    uint32_t load[RGB7SEG_MAX_DIGITS + 1];
+
+    if (!p->marquee.active)
+        return;
+
+    copy_leds(p->pixels, 0, p->marquee.strip, p->marquee.pos * digit_leds, indicator_led);
+    for (int i = 0; i < INDICATORS; i++)
+    {
+        put_led(p->pixels, indicator_led + i, led_off);
+    }
+    p->load = 0;
+    for (int i = 0; i < digits; i++)
+    {
+        p->load += p->marquee.load[p->marquee.pos + i];
+    }
+    p->frame_pending = true;
+
+    if (++p->marquee.pos == p->marquee.len)
+    {
+        p->marquee.pos = 0;
+        if (p->marquee.repeat > 0 && --p->marquee.repeat == 0)
+        {
+            // all passes done, leave the beginning of the text visible
+            marquee_stop(p);
+            p->load = set_7seg(p->pixels, p->marquee.text, p->marquee.colors, load);
+        }
+    }
+}
+
+static void scroll_timer_cb(void *arg)
+{
+    struct panel *p = arg;
+
+    p->scroll_due = true;
+    xTaskNotify(display_task_handle, NOTIFY_SCROLL, eSetBits);
+}
+
+static bool IRAM_ATTR blink_timer_cb(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx)
+{
+    BaseType_t woken = pdFALSE;
+
+    xTaskNotifyFromISR(display_task_handle, NOTIFY_BLINK, eSetBits, &woken);
+    return woken == pdTRUE;
+}
+
+// redraws static content when it has a blinking indicator
+static void blink_toggle(struct panel *p)
+{
+    uint32_t load[RGB7SEG_MAX_DIGITS + 1];
+
+    if (p->anim.transition != RGB7SEG_NONE || p->marquee.active)
+        return;
+
+    if ((indicators[RGB7SEG_COLON].blink && strchr(p->current.text, ':')) ||
+        (indicators[RGB7SEG_DP].blink && strchr(p->current.text, '.')))
+    {
+        p->load = set_7seg(p->pixels, p->current.text, p->current.colors, load);
+        p->frame_pending = true;
+    }
+}
+
+void rgb7seg_set_indicator(enum rgb7seg_indicator which, struct color *c, bool blink)
+{
+    struct indicator ind = {
+        .owncolor = (c != NULL),
+        .blink = blink,
+    };
+
+    if (c != NULL)
+        ind.c = *c;
+    xQueueOverwrite(indicator_mailbox[which], &ind);
+    xTaskNotify(display_task_handle, NOTIFY_SETTINGS, eSetBits);
+}
+
+// FNV-1a
+static uint32_t frame_hash(const uint8_t *p)
+{
+    uint32_t hash = 2166136261u;
+
+    for (int i = 0; i < frame_size; i++)
+    {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Returns the entry with the symbols of the frame, on a miss the least
+// recently used entry is encoded again. Entries used in the current round
+// may be on the wire and are not replaced, NULL when all of them are.
+static struct symcache_entry *symcache_get(const uint8_t *pixels)
+{
+    uint32_t hash = frame_hash(pixels);
+    struct symcache_entry *victim = NULL;
+
+    for (int i = 0; i < symcache_entries; i++)
+    {
+        struct symcache_entry *e = &symcache[i];
+
+        if (e->used && e->hash == hash && !memcmp(e->pixels, pixels, frame_size))
+        {
+            e->used = ++symcache_clock;
+            stats.cachehits++;
+            return e;
+        }
+        if (e->used <= symcache_round && (victim == NULL || e->used < victim->used))
+            victim = e;
+    }
+    if (victim == NULL)
+        return NULL;
+    stats.cachemisses++;
+    victim->hash = hash;
+    victim->used = ++symcache_clock;
+    memcpy(victim->pixels, pixels, frame_size);
+    led_strip_encode_symbols(&encoder_config, pixels, frame_size, victim->symbols);
+#if CONFIG_RGB7SEG_VERIFY_SYMBOLS
+    if (led_strip_decode_symbols(&encoder_config, victim->symbols, LED_STRIP_SYMBOLS(frame_size),
+            symcache_check, frame_size) != frame_size || memcmp(symcache_check, pixels, frame_size))
+    {
+        ESP_LOGE(TAG, "cached symbols do not decode back to the frame");
+    }
+#endif
+    return victim;
+}
+
+static void init_symcache(void)
+{
+    int symbols_size = LED_STRIP_SYMBOLS(frame_size) * sizeof(rmt_symbol_word_t);
+
+#if CONFIG_RGB7SEG_PALETTE_FRAMES
+    // cached symbols would take the ram palette frames save
+    ESP_LOGI(TAG, "symbol cache disabled with palette frames");
+    return;
+#endif
+#if CONFIG_RGB7SEG_DITHER
+    // every refresh is a different frame
+    ESP_LOGI(TAG, "symbol cache disabled with dithering");
+    return;
+#endif
+#if CONFIG_RGB7SEG_OUTPUT_CONSOLE
+    return;
+#endif
+    symcache_entries = CONFIG_RGB7SEG_SYMBOL_CACHE_KB * 1024 / (frame_size + symbols_size);
+    if (symcache_entries == 0)
+    {
+        ESP_LOGI(TAG, "symbol cache disabled");
+        return;
+    }
+    symcache = calloc(symcache_entries, sizeof(struct symcache_entry));
+    assert(symcache);
+    for (int i = 0; i < symcache_entries; i++)
+    {
+        symcache[i].pixels = malloc(frame_size);
+        symcache[i].symbols = malloc(symbols_size);
+        assert(symcache[i].pixels && symcache[i].symbols);
+    }
+#if CONFIG_RGB7SEG_VERIFY_SYMBOLS
+    symcache_check = malloc(frame_size);
+    assert(symcache_check);
+#endif
+    ESP_LOGI(TAG, "symbol cache %d frames of %d bytes", symcache_entries, frame_size + symbols_size);
+}
+
+// swaps buffers, the new front buffer is sent in the next round
+static void swap_buffers(struct panel *p)
+{
+    p->back ^= 1;
+    p->pixels = p->framebuffers[p->back];
+    p->front_valid = true;
+    p->inflight_src = p->pending_src;
+    p->inflight_queued = p->pending_queued;
+    p->pending_queued = 0; // following animation frames are not counted in latency
+    stats.sent++;
+}
+
+#if !CONFIG_RGB7SEG_DITHER
+// only static frames are worth caching
+static void transmit_panel(struct panel *p)
+{
+    output->send(p, p->framebuffers[p->back ^ 1], p->anim.transition == RGB7SEG_NONE && !p->marquee.active);
+}
+#endif
+
+// Estimated current of the back buffer. Over the budget the frame is dimmed
+// uniformly, returns the scale in 1/256.
+static uint16_t limit_current(struct panel *p, uint32_t *ma)
+{
+    *ma = (uint64_t) p->load * CONFIG_RGB7SEG_UA_PER_STEP / 1000;
+    if (CONFIG_RGB7SEG_CURRENT_BUDGET_MA == 0 || *ma <= CONFIG_RGB7SEG_CURRENT_BUDGET_MA)
+        return 256;
+#if CONFIG_RGB7SEG_PALETTE_FRAMES
+    // palette indexes can not be dimmed, current is only estimated
+    return 256;
+#else
+    uint16_t scale = CONFIG_RGB7SEG_CURRENT_BUDGET_MA * 256 / *ma;
+#if !CONFIG_RGB7SEG_DITHER
+    // with dithering the scale is applied when refreshes are prepared
+    for (int i = 0; i < frame_size; i++)
+    {
+        p->pixels[i] = (p->pixels[i] * scale) >> 8;
+    }
+#endif
+    *ma = *ma * scale >> 8;
+    stats.limited++;
+    return scale;
+#endif
+}
+
+// swaps the changed panels, returns how many there were
+static int swap_pending(bool *send)
+{
+    int n = 0;
+
+    for (int i = 0; i < RGB7SEG_PANELS; i++)
+    {
+        struct panel *p = &panels[i];
+        uint32_t ma;
+        uint16_t scale;
+
+        send[i] = false;
+        if (!p->frame_pending)
+            continue;
+        p->frame_pending = false;
+        scale = limit_current(p, &ma);
+        if (p->front_valid && !memcmp(p->framebuffers[p->back ^ 1], p->pixels, frame_size))
+        {
+            stats.skipped++;
+            continue;
+        }
+        p->ma = ma;
+        p->scale = scale;
+        swap_buffers(p);
+        send[i] = true;
+        n++;
+    }
+    if (n)
+    {
+        stats.currentma = 0;
+        for (int i = 0; i < RGB7SEG_PANELS; i++)
+        {
+            stats.currentma += panels[i].ma;
+        }
+    }
+    return n;
+}
+
+// With a sync manager the channels start when all of them have a frame,
+// the manager has to be reset before the next round.
+static void round_start(int n)
+{
+    tx_busy = true;
+    tx_outstanding = n;
+    round_started = esp_timer_get_time();
+#if RGB7SEG_SYNC_PANELS
+    esp_err_t err = rmt_sync_reset(sync_manager);
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "rmt sync reset failed: %s", esp_err_to_name(err));
+#endif
+}
+
+#if !CONFIG_RGB7SEG_DITHER
+// Starts a round with all changed panels. With a sync manager every channel
+// has to take part, unchanged panels send their front buffer again.
+static void start_transmit(void)
+{
+    bool send[RGB7SEG_PANELS];
+    int n = swap_pending(send);
+
+    if (n == 0)
+        return;
+
+#if RGB7SEG_SYNC_PANELS
+    for (int i = 0; i < RGB7SEG_PANELS; i++)
+    {
+        if (!send[i])
+            panels[i].inflight_queued = 0;
+        send[i] = true;
+    }
+    n = RGB7SEG_PANELS;
+#endif
+    round_start(n);
+    symcache_round = symcache_clock;
+    for (int i = 0; i < RGB7SEG_PANELS; i++)
+    {
+        if (send[i])
+            transmit_panel(&panels[i]);
+    }
+}
+#endif
+
+#if CONFIG_RGB7SEG_DITHER
+static void dither_prepare(struct panel *p, uint8_t *out)
+{
+    const uint8_t *src = p->framebuffers[p->back ^ 1];
+    uint8_t *err = p->dither_err;
+
+    for (int i = 0; i < frame_size; i++)
+    {
+        uint32_t v = ((level16_lut[src[i]] * p->scale) >> 8) + err[i];
+        out[i] = v >> 8;
+        err[i] = v;
+    }
+    p->prepared_src = p->inflight_src;
+    p->prepared_queued = p->inflight_queued;
+    p->inflight_queued = 0;
+}
+
+// Sends the prepared frames of all panels, and prepares the next ones from
+// the front buffers while these are on the wire.
+static void dither_refresh(void)
+{
+    int64_t start = esp_timer_get_time();
+
+    if (tx_busy)
+    {
+        stats.refreshlate++;
+        return;
+    }
+    round_start(RGB7SEG_PANELS);
+    for (int i = 0; i < RGB7SEG_PANELS; i++)
+    {
+        struct panel *p = &panels[i];
+
+        p->wire_src = p->prepared_src;
+        p->wire_queued = p->prepared_queued;
+        p->prepared_queued = 0;
+        output->send(p, p->dither_out[p->dither_next], false);
+    }
+    for (int i = 0; i < RGB7SEG_PANELS; i++)
+    {
+        struct panel *p = &panels[i];
+
+        p->dither_next ^= 1;
+        dither_prepare(p, p->dither_out[p->dither_next]);
+    }
+    stats.refreshes++;
+    dither_busy_us += esp_timer_get_time() - start;
+}
+
+static void refresh_timer_cb(void *arg)
+{
+    xTaskNotify(display_task_handle, NOTIFY_REFRESH, eSetBits);
+}
+#endif
+
+static void IRAM_ATTR frame_latency(struct panel *p)
+{
+#if CONFIG_RGB7SEG_DITHER
+    enum rgb7seg_source src = p->wire_src;
+    int64_t queued = p->wire_queued;
+#else
+    enum rgb7seg_source src = p->inflight_src;
+    int64_t queued = p->inflight_queued;
+#endif
+
+    if (queued)
+    {
+        struct rgb7seg_latency *lat = &stats.latency[src];
+        uint32_t elapsed = esp_timer_get_time() - queued;
+
+        lat->count++;
+        lat->total_us += elapsed;
+        if (elapsed > lat->max_us) lat->max_us = elapsed;
+    }
+}
+
+// channels finish in their own interrupts, true when this was the last one
+static bool IRAM_ATTR channel_done(void)
+{
+    return __atomic_sub_fetch(&tx_outstanding, 1, __ATOMIC_SEQ_CST) == 0;
+}
+
+#if CONFIG_RGB7SEG_OUTPUT_CONSOLE
+// backends sending from the display task
+static void frame_sent(struct panel *p)
+{
+    frame_latency(p);
+    if (channel_done())
+        xTaskNotify(display_task_handle, NOTIFY_TXDONE, eSetBits);
+}
+#endif
+
+static bool IRAM_ATTR tx_done_cb(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *edata, void *user_ctx)
+{
+    BaseType_t woken = pdFALSE;
+
+    frame_latency(user_ctx);
+    if (channel_done())
+        xTaskNotifyFromISR(display_task_handle, NOTIFY_TXDONE, eSetBits, &woken);
+    return woken == pdTRUE;
+}
+
+static void rmt_output_init(struct panel *p, int gpio)
+{
+    rmt_tx_event_callbacks_t cbs = {
+        .on_trans_done = tx_done_cb,
+    };
+    rmt_copy_encoder_config_t copy_config = {};
+
+    tx_chan_config.gpio_num = gpio;
+    ESP_ERROR_CHECK(rmt_new_tx_channel(&tx_chan_config, &p->chan));
+    ESP_ERROR_CHECK(rmt_tx_register_event_callbacks(p->chan, &cbs, p));
+#if CONFIG_RGB7SEG_PALETTE_FRAMES
+    // with an odd number of leds one extra dark led is sent after the last one
+    led_strip_palette_encoder_config_t palette_config = {
+        .resolution = RMT_LED_STRIP_RESOLUTION_HZ,
+        .palette = palette,
+    };
+    ESP_ERROR_CHECK(rmt_new_led_palette_encoder(&palette_config, &p->encoder));
+#else
+    ESP_ERROR_CHECK(rmt_new_led_strip_encoder(&encoder_config, &p->encoder));
+#endif
+    if (symcache_entries)
+        ESP_ERROR_CHECK(rmt_new_copy_encoder(&copy_config, &p->copy_encoder));
+    ESP_ERROR_CHECK(rmt_enable(p->chan));
+}
+
+// A frame which could not be queued is not waited for. With a sync manager
+// the other channels do not start either, the display task ends the round
+// after TX_DONE_TIMEOUT_MS.
+static void rmt_output_send(struct panel *p, const uint8_t *pixels, bool cacheable)
+{
+    struct symcache_entry *e = NULL;
+    esp_err_t err;
+
+    if (symcache_entries && cacheable)
+        e = symcache_get(pixels);
+    if (e != NULL)
+    {
+        err = rmt_transmit(p->chan, p->copy_encoder, e->symbols,
+            LED_STRIP_SYMBOLS(frame_size) * sizeof(rmt_symbol_word_t), &tx_config);
+    }
+    else
+    {
+        err = rmt_transmit(p->chan, p->encoder, pixels, frame_size, &tx_config);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "panel %d transmit failed: %s", (int) (p - panels), esp_err_to_name(err));
+        if (channel_done())
+            xTaskNotify(display_task_handle, NOTIFY_TXDONE, eSetBits);
+    }
+}
+
+static const struct output rmt_output =
+{
+    .init = rmt_output_init,
+    .send = rmt_output_send,
+};
+
+#if CONFIG_RGB7SEG_OUTPUT_CONSOLE
+static void console_output_init(struct panel *p, int gpio)
+{
+    ESP_LOGI(TAG, "panel %d on console instead of gpio %d", (int) (p - panels), gpio);
+}
+
+// wire order back to rgb, scaled up so that dimmed leds are still visible
+static struct color console_color(const uint8_t *pixels, int led)
+{
+    const uint8_t *w;
+    struct color c;
+
+#if CONFIG_RGB7SEG_PALETTE_FRAMES
+    uint8_t v = pixels[led / 2];
+    w = &palette[((led & 1) ? v >> 4 : v & 0x0f) * sizeof(struct pixel)];
+#else
+    w = ((const struct pixel *) pixels)[led].wire;
+#endif
+#if CONFIG_RGB7SEG_COLOR_ORDER_GRB
+    c = (struct color) { w[1], w[0], w[2] };
+#elif CONFIG_RGB7SEG_COLOR_ORDER_BRG
+    c = (struct color) { w[1], w[2], w[0] };
+#else
+    c = (struct color) { w[0], w[1], w[2] };
+#endif
+    int max = c.r > c.g ? c.r : c.g;
+    if (c.b > max) max = c.b;
+    if (max)
+    {
+        c.r = c.r * 255 / max;
+        c.g = c.g * 255 / max;
+        c.b = c.b * 255 / max;
+    }
+    return c;
+}
+
+// prints ch in the color of the led, or a space when the led is dark
+static void console_led(const uint8_t *pixels, int led, char ch)
+{
+    struct color c = console_color(pixels, led);
+
+    if (c.r | c.g | c.b)
+        printf("\033[38;2;%d;%d;%dm%c", c.r, c.g, c.b, ch);
+    else
+        putchar(' ');
+}
+
+// Three text rows per frame, color of a segment is the color of its first led.
+static void console_output_send(struct panel *p, const uint8_t *pixels, bool cacheable)
+{
+    // segment drawn at each column of a row, -1 is always empty
+    static const int8_t rows[3][3] = {
+        { -1, 0, -1 },  // a
+        { 5, 6, 1 },    // f g b
+        { 4, 3, 2 },    // e d c
+    };
+    static const char shapes[3][3] = {
+        { ' ', '_', ' ' },
+        { '|', '_', '|' },
+        { '|', '_', '|' },
+    };
+
+    for (int row = 0; row < 3; row++)
+    {
+        printf("%d ", (int) (p - panels));
+        for (int d = 0; d < digits; d++)
+        {
+            for (int col = 0; col < 3; col++)
+            {
+                int s = rows[row][col];
+                if (s < 0)
+                    putchar(' ');
+                else
+                    console_led(pixels, d * digit_leds + seg_map[s], shapes[row][col]);
+            }
+        }
+        if (row == 1)
+            console_led(pixels, indicator_led + RGB7SEG_COLON, ':');
+        if (row == 2)
+            console_led(pixels, indicator_led + RGB7SEG_DP, '.');
+        printf("\033[0m\n");
+    }
+    frame_sent(p);
+}
+
+static const struct output console_output =
+{
+    .init = console_output_init,
+    .send = console_output_send,
+};
+#endif
+
+#if CONFIG_RGB7SEG_PALETTE_FRAMES
+// Emptying a full palette invalidates the indexes in every buffer, so the
+// other panels are rendered again with the new palette. An animation jumps
+// to its end, a marquee goes on from its position. Only when nothing is on
+// the wire, the encoder reads the palette.
+static bool palette_reset(struct panel *except)
+{
+    uint32_t load[RGB7SEG_MAX_DIGITS + 1];
+
+    if (palette_used < PALETTE_SIZE || tx_busy)
+        return false;
+    palette_used = 1;
+    for (int i = 0; i < RGB7SEG_PANELS; i++)
+    {
+        struct panel *p = &panels[i];
+
+        p->front_valid = false;
+        if (p == except)
+            continue;
+        animation_stop(p);
+        if (p->marquee.active)
+        {
+            marquee_render(p);
+            marquee_step(p);
+        }
+        else
+        {
+            p->load = set_7seg(p->pixels, p->current.text, p->current.colors, load);
+            p->frame_pending = true;
+        }
+    }
+    return true;
+}
+#endif
+
+static void show_cmd(struct panel *p, struct displaycmd *cmd)
+{
+    uint32_t load[RGB7SEG_MAX_DIGITS + 1];
+
+#if CONFIG_RGB7SEG_PALETTE_FRAMES
+    // palette frames can not hold blended colors, and the old
+    // content is lost when a full palette is emptied
+    if (palette_reset(p) || cmd->transition != RGB7SEG_SLIDE)
+        cmd->transition = RGB7SEG_NONE;
+#endif
+    p->pending_src = cmd->src;
+    p->pending_queued = cmd->queued;
+    p->current = *cmd;
+    marquee_stop(p);
+    animation_stop(p);
+    if (cmd->steptime > 0)
+    {
+        marquee_start(p, cmd);
+        p->scroll_due = true;
+    }
+    else if (cmd->transition != RGB7SEG_NONE)
+    {
+        animation_start(p, cmd);
+    }
+    else
+    {
+        p->load = set_7seg(p->pixels, cmd->text, cmd->colors, load);
+        p->frame_pending = true;
+    }
+}
+
+// one pass of the display task over the notified events
+static void display_events(uint32_t events)
+{
+    struct displaycmd cmd;
+    uint8_t brightness;
+
+    // a lost done interrupt or a channel which was not queued keeps the
+    // round open, checked on every pass as ticks and refreshes wake the
+    // task long before the wait in display_task() times out
+    if (tx_busy && !(events & NOTIFY_TXDONE) &&
+        esp_timer_get_time() - round_started > TX_DONE_TIMEOUT_MS * 1000LL)
+    {
+        ESP_LOGE(TAG, "timeout waiting rmt transmission");
+        tx_outstanding = 0;
+        events |= NOTIFY_TXDONE;
+    }
+    if (events & NOTIFY_TXDONE)
+    {
+        tx_busy = false;
+    }
+
+    // the encoder reads the palette while sending
+    if (!tx_busy && xQueueReceive(brightness_mailbox, &brightness, 0))
+    {
+        apply_brightness(brightness);
+    }
+
+    if (events & NOTIFY_SETTINGS)
+    {
+        for (int i = 0; i < RGB7SEG_INDICATOR_CNT; i++)
+        {
+            xQueueReceive(indicator_mailbox[i], &indicators[i], 0);
+        }
+    }
+
+    if (events & NOTIFY_BLINK)
+    {
+        blink_off = !blink_off;
+    }
+
+    for (int i = 0; i < RGB7SEG_PANELS; i++)
+    {
+        struct panel *p = &panels[i];
+
+        if ((events & NOTIFY_CMD) && xQueueReceive(p->mailbox, &cmd, 0))
+        {
+            show_cmd(p, &cmd);
+            if (p->anim.transition != RGB7SEG_NONE)
+                events |= NOTIFY_TICK;
+        }
+
+        if (events & NOTIFY_TICK)
+        {
+            animation_tick(p);
+        }
+
+        if (p->scroll_due)
+        {
+            p->scroll_due = false;
+            marquee_step(p);
         }
+
+        if (events & NOTIFY_BLINK)
+        {
+            blink_toggle(p);
+        }
+    }
+
+#if CONFIG_RGB7SEG_DITHER
+    // front buffers are only read by the refresh, they can be swapped any time
+    bool swapped[RGB7SEG_PANELS];
+    swap_pending(swapped);
+    if (events & NOTIFY_REFRESH)
+    {
+        dither_refresh();
+    }
+#else
+    if (!tx_busy)
+    {
+        start_transmit();
     }
+#endif
 }
 
-void rgb7seg_display(char *buff, struct color c)
+static void display_task(void *arg)
 {
-    set_7seg(buff,c);
-    ESP_ERROR_CHECK(rmt_transmit(led_chan, led_encoder, led_strip_pixels, sizeof(led_strip_pixels), &tx_config));
+    uint32_t events;
 
+    while (1)
+    {
+        TickType_t timeout = portMAX_DELAY;
+
+        // wakes up once the round is overdue, display_events() ends it
+        if (tx_busy)
+        {
+            int64_t left = round_started + TX_DONE_TIMEOUT_MS * 1000LL - esp_timer_get_time();
+            timeout = left > 0 ? left / 1000 / portTICK_PERIOD_MS + 1 : 0;
+        }
+        if (!xTaskNotifyWait(0, UINT32_MAX, &events, timeout))
+        {
+            events = 0;
+        }
+        display_events(events);
+    }
 }
-void rgb7seg_init(void)
+
+// when there are less colors than digits, the last one is used for the rest
+static void post_cmd(int panel, struct displaycmd *cmd, char *buff, const struct color *colors, int ncolors, enum rgb7seg_source src)
+{
+    if (panel < 0 || panel >= RGB7SEG_PANELS)
+    {
+        ESP_LOGW(TAG, "no panel %d", panel);
+        return;
+    }
+    strncpy(cmd->text, buff, RGB7SEG_TEXT_LEN - 1);
+    cmd->text[RGB7SEG_TEXT_LEN - 1] = 0;
+    for (int i = 0; i < digits; i++)
+    {
+        cmd->colors[i] = colors[(i < ncolors) ? i : ncolors - 1];
+    }
+    cmd->src = src;
+    cmd->queued = esp_timer_get_time();
+    xQueueOverwrite(panels[panel].mailbox, cmd);
+    xTaskNotify(display_task_handle, NOTIFY_CMD, eSetBits);
+}
+
+void rgb7seg_animate(int panel, char *buff, struct color c, enum rgb7seg_source src, enum rgb7seg_transition transition, int ms)
+{
+    struct displaycmd cmd = {
+        .transition = transition,
+        .ms = ms,
+    };
+
+    post_cmd(panel, &cmd, buff, &c, 1, src);
+}
+
+void rgb7seg_marquee(int panel, char *buff, struct color c, enum rgb7seg_source src, int steptime, int repeat)
+{
+    struct displaycmd cmd = {
+        .steptime = (steptime > 0) ? steptime : 1,
+        .repeat = repeat,
+    };
+
+    post_cmd(panel, &cmd, buff, &c, 1, src);
+}
+
+// colors as with rgb7seg_display_colors(), stretched along the text
+void rgb7seg_marquee_colors(int panel, char *buff, const struct color *colors, int ncolors, enum rgb7seg_source src, int steptime, int repeat)
 {
-    ESP_ERROR_CHECK(rmt_new_tx_channel(&tx_chan_config, &led_chan));
-    ESP_ERROR_CHECK(rmt_new_led_strip_encoder(&encoder_config, &led_encoder));
-    ESP_ERROR_CHECK(rmt_enable(led_chan));
+    struct displaycmd cmd = {
+        .steptime = (steptime > 0) ? steptime : 1,
+        .repeat = repeat,
+    };
+
+    if (ncolors < 1)
+        return;
+    post_cmd(panel, &cmd, buff, colors, ncolors, src);
+}
+
+void rgb7seg_display(int panel, char *buff, struct color c, enum rgb7seg_source src)
+{
+    rgb7seg_animate(panel, buff, c, src, RGB7SEG_NONE, 0);
+}
+
+void rgb7seg_display_colors(int panel, char *buff, const struct color *colors, int ncolors, enum rgb7seg_source src)
+{
+    struct displaycmd cmd = { 0 };
+
+    if (ncolors < 1)
+        return;
+    post_cmd(panel, &cmd, buff, colors, ncolors, src);
+}
+
+// fills colors[] with one color for each digit, returns the number of digits
+int rgb7seg_gradient(struct color from, struct color to, struct color *colors)
+{
+    if (digits == 1)
+    {
+        colors[0] = from;
+        return 1;
+    }
+    for (int i = 0; i < digits; i++)
+    {
+        colors[i].r = from.r + (to.r - from.r) * i / (digits - 1);
+        colors[i].g = from.g + (to.g - from.g) * i / (digits - 1);
+        colors[i].b = from.b + (to.b - from.b) * i / (digits - 1);
+    }
+    return digits;
+}
+
+void rgb7seg_display_gradient(int panel, char *buff, struct color from, struct color to, enum rgb7seg_source src)
+{
+    struct color colors[RGB7SEG_MAX_DIGITS];
+
+    rgb7seg_display_colors(panel, buff, colors, rgb7seg_gradient(from, to, colors), src);
+}
+
+int rgb7seg_digits(void)
+{
+    return digits;
+}
+
+void rgb7seg_default_layout(struct rgb7seg_layout *l)
+{
+    l->digits = CONFIG_RGB7SEG_DIGITS;
+    l->segleds = CONFIG_RGB7SEG_SEGMENT_LEDS;
+    strncpy(l->order, CONFIG_RGB7SEG_SEGMENT_ORDER, sizeof(l->order) - 1);
+    l->order[sizeof(l->order) - 1] = 0;
+}
+
+// order has to have every segment a..g exactly once
+static bool layout_valid(const struct rgb7seg_layout *l)
+{
+    uint8_t seen = 0;
+
+    if (l->digits < 1 || l->digits > RGB7SEG_MAX_DIGITS)
+        return false;
+    if (l->segleds < 1 || l->segleds > RGB7SEG_MAX_SEGLEDS)
+        return false;
+    if (strlen(l->order) != SEGMENTS)
+        return false;
+    for (int i = 0; i < SEGMENTS; i++)
+    {
+        int s = l->order[i] - 'a';
+        if (s < 0 || s >= SEGMENTS || (seen & (1 << s)))
+            return false;
+        seen |= 1 << s;
+    }
+    return true;
+}
+
+static void init_layout(const struct rgb7seg_layout *l)
+{
+    if (l == NULL || !layout_valid(l))
+    {
+        if (l != NULL)
+            ESP_LOGW(TAG, "invalid layout %d digits, %d leds, order %s, using defaults", l->digits, l->segleds, l->order);
+        rgb7seg_default_layout(&layout);
+    }
+    else
+    {
+        layout = *l;
+    }
+
+    for (int i = 0; i < SEGMENTS; i++)
+    {
+        seg_map[layout.order[i] - 'a'] = i * layout.segleds;
+    }
+    digits = layout.digits;
+    digit_leds = SEGMENTS * layout.segleds;
+    indicator_led = digits * digit_leds;
+    strip_leds = indicator_led + INDICATORS;
+    frame_size = FRAME_BYTES(strip_leds);
+    marquee_size = FRAME_BYTES((RGB7SEG_TEXT_LEN + 2 * digits) * digit_leds);
+
+    ESP_LOGI(TAG, "layout %d digits, %d leds per segment, order %s, %d leds",
+        digits, layout.segleds, layout.order, strip_leds);
+}
+
+static void init_panel(struct panel *p, int gpio)
+{
+    esp_timer_create_args_t scroll_args = {
+        .callback = scroll_timer_cb,
+        .arg = p,
+        .name = "rgb7seg scroll",
+    };
+
+    p->framebuffers[0] = calloc(1, frame_size);
+    p->framebuffers[1] = calloc(1, frame_size);
+    p->anim.from = malloc(frame_size);
+    p->anim.to = malloc(frame_size);
+    p->marquee.strip = malloc(marquee_size);
+    assert(p->framebuffers[0] && p->framebuffers[1] && p->anim.from && p->anim.to && p->marquee.strip);
+    p->back = 0;
+    p->pixels = p->framebuffers[p->back];
+    p->scale = 256;
+#if CONFIG_RGB7SEG_DITHER
+    p->dither_out[0] = calloc(1, frame_size);
+    p->dither_out[1] = calloc(1, frame_size);
+    p->dither_err = calloc(1, frame_size);
+    assert(p->dither_out[0] && p->dither_out[1] && p->dither_err);
+#endif
+    p->mailbox = xQueueCreate(1, sizeof(struct displaycmd));
+    ESP_ERROR_CHECK(esp_timer_create(&scroll_args, &p->scroll_timer));
+    output->init(p, gpio);
+}
+
+struct rgb7seg_stats *rgb7seg_getstats(void)
+{
+#if CONFIG_RGB7SEG_DITHER
+    int64_t now = esp_timer_get_time();
+
+    if (now > dither_since)
+        stats.dithercpu = dither_busy_us * 1000 / (now - dither_since);
+    dither_busy_us = 0;
+    dither_since = now;
+#endif
+    return &stats;
+}
+
+void rgb7seg_init(const struct rgb7seg_layout *l)
+{
+    esp_timer_create_args_t timer_args = {
+        .callback = animation_timer_cb,
+        .name = "rgb7seg anim",
+    };
+    gptimer_config_t blink_config = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = 1000000, // 1 tick = 1us
+    };
+    gptimer_alarm_config_t blink_alarm = {
+        .alarm_count = BLINK_PERIOD_US,
+        .reload_count = 0,
+        .flags.auto_reload_on_alarm = true,
+    };
+    gptimer_event_callbacks_t blink_cbs = {
+        .on_alarm = blink_timer_cb,
+    };
+
+    init_layout(l);
+    output = &rmt_output;
+#if CONFIG_RGB7SEG_OUTPUT_CONSOLE
+    output = &console_output;
+#endif
+    apply_brightness(RGB7SEG_DEFAULT_BRIGHTNESS);
+    brightness_mailbox = xQueueCreate(1, sizeof(uint8_t));
+    for (int i = 0; i < RGB7SEG_INDICATOR_CNT; i++)
+    {
+        indicator_mailbox[i] = xQueueCreate(1, sizeof(struct indicator));
+    }
+    init_animation_tables();
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &anim_timer));
+    init_symcache();
+    for (int i = 0; i < RGB7SEG_PANELS; i++)
+    {
+        init_panel(&panels[i], panel_gpios[i]);
+    }
+#if RGB7SEG_SYNC_PANELS
+    rmt_channel_handle_t chans[RGB7SEG_PANELS];
+    for (int i = 0; i < RGB7SEG_PANELS; i++)
+    {
+        chans[i] = panels[i].chan;
+    }
+    rmt_sync_manager_config_t sync_config = {
+        .tx_channel_array = chans,
+        .array_size = RGB7SEG_PANELS,
+    };
+    ESP_ERROR_CHECK(rmt_new_sync_manager(&sync_config, &sync_manager));
+#endif
+    // below mqtt task priority, animations drop frames instead of delaying network or sensors
+    xTaskCreate(display_task, "rgb7seg display", DISPLAY_STACK, NULL, 4, &display_task_handle);
+#if CONFIG_RGB7SEG_DITHER
+    esp_timer_create_args_t refresh_args = {
+        .callback = refresh_timer_cb,
+        .name = "rgb7seg refresh",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&refresh_args, &refresh_timer));
+    dither_since = esp_timer_get_time();
+    ESP_ERROR_CHECK(esp_timer_start_periodic(refresh_timer, 1000000 / CONFIG_RGB7SEG_DITHER_HZ));
+#endif
+
+    ESP_ERROR_CHECK(gptimer_new_timer(&blink_config, &blink_timer));
+    ESP_ERROR_CHECK(gptimer_register_event_callbacks(blink_timer, &blink_cbs, NULL));
+    ESP_ERROR_CHECK(gptimer_set_alarm_action(blink_timer, &blink_alarm));
+    ESP_ERROR_CHECK(gptimer_enable(blink_timer));
+    ESP_ERROR_CHECK(gptimer_start(blink_timer));
 }
\ No newline at end of file
@@ -1,6 +1,9 @@
 #ifndef __RGB7SEG__
 #define __RGB7SEG__
 
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
 
 struct color 
 {
@@ -9,7 +12,84 @@ struct color
     uint8_t b;
 };
 
-void rgb7seg_init(void);
-void rgb7seg_display(char *buff, struct color c);
+#define RGB7SEG_PANELS      CONFIG_RGB7SEG_PANELS
+#define RGB7SEG_MAX_DIGITS  8
+#define RGB7SEG_MAX_SEGLEDS 4
+#define RGB7SEG_TEXT_LEN 32
+#define RGB7SEG_DEFAULT_BRIGHTNESS 50
+
+// Physical geometry of the display. Digits are chained one after another,
+// each has 7 segments of segleds leds. Order tells in which order the
+// segments a..g are wired inside a digit, for example "abcdefg".
+// Colon and decimal point leds follow the last digit.
+struct rgb7seg_layout
+{
+    uint8_t digits;
+    uint8_t segleds;
+    char order[8];
+};
+
+// who asked for the display update, latency is measured per source.
+enum rgb7seg_source
+{
+    RGB7SEG_SRC_MAIN,
+    RGB7SEG_SRC_MQTT,
+    RGB7SEG_SRC_WIFI,
+    RGB7SEG_SRC_CNT
+};
+
+// leds after the digits, lit by ':' and '.' in the displayed text
+enum rgb7seg_indicator
+{
+    RGB7SEG_COLON,
+    RGB7SEG_DP,
+    RGB7SEG_INDICATOR_CNT
+};
+
+enum rgb7seg_transition
+{
+    RGB7SEG_NONE,
+    RGB7SEG_FADE,   // cross-fade from the old content
+    RGB7SEG_SLIDE,  // old digits slide out, new ones in
+    RGB7SEG_PULSE   // brightness pulse on the new content
+};
+
+struct rgb7seg_latency
+{
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us;
+};
+
+struct rgb7seg_stats
+{
+    uint32_t sent;     // frames transmitted to the strip
+    uint32_t skipped;  // frames dropped, because they were identical to the latched one
+    uint32_t animframes;   // animation frames rendered
+    uint32_t animdropped;  // animation frames dropped to keep cpu budget
+    uint32_t cachehits;    // static frames sent from the symbol cache
+    uint32_t cachemisses;  // static frames encoded to the symbol cache
+    uint32_t refreshes;    // dithered refreshes sent
+    uint32_t refreshlate;  // refreshes missed, because the previous one was still on the wire
+    uint32_t dithercpu;    // cpu used by refreshes since the previous read, 1/1000
+    uint32_t currentma;    // estimated current of all panels
+    uint32_t limited;      // frames dimmed to keep the current budget
+    struct rgb7seg_latency latency[RGB7SEG_SRC_CNT]; // from request until frame is on the wire
+};
+
+void rgb7seg_default_layout(struct rgb7seg_layout *layout);
+void rgb7seg_init(const struct rgb7seg_layout *layout);
+int rgb7seg_digits(void);
+int rgb7seg_text_digits(const char *text);
+void rgb7seg_display(int panel, char *buff, struct color c, enum rgb7seg_source src);
+void rgb7seg_animate(int panel, char *buff, struct color c, enum rgb7seg_source src, enum rgb7seg_transition transition, int ms);
+void rgb7seg_display_colors(int panel, char *buff, const struct color *colors, int ncolors, enum rgb7seg_source src);
+void rgb7seg_display_gradient(int panel, char *buff, struct color from, struct color to, enum rgb7seg_source src);
+void rgb7seg_marquee(int panel, char *buff, struct color c, enum rgb7seg_source src, int steptime, int repeat);
+void rgb7seg_marquee_colors(int panel, char *buff, const struct color *colors, int ncolors, enum rgb7seg_source src, int steptime, int repeat);
+int rgb7seg_gradient(struct color from, struct color to, struct color *colors);
+void rgb7seg_set_brightness(uint8_t brightness);
+void rgb7seg_set_indicator(enum rgb7seg_indicator which, struct color *c, bool blink);
+struct rgb7seg_stats *rgb7seg_getstats(void);
 
 #endif
\ No newline at end of file
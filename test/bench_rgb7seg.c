@@ -0,0 +1,108 @@
+// Timings of the display hot paths on the host, in ns per call. Only the
+// relative numbers mean something for the device.
+#include <time.h>
+#include "rgb7seg.c"
+
+
+static uint8_t *frame;
+static uint32_t load[RGB7SEG_MAX_DIGITS + 1];
+static const struct color colors[RGB7SEG_MAX_DIGITS] =
+{
+    { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 }, { 200, 100, 50 },
+    { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 }, { 200, 100, 50 },
+};
+static rmt_symbol_word_t *symbols;
+static ledval digit_color;
+static volatile uint32_t sink;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// doubles the iterations until a run takes 100ms
+static void bench(const char *name, void (*fn)(void))
+{
+    int64_t n = 1000;
+    int64_t t;
+
+    for (;;)
+    {
+        int64_t start = now_ns();
+
+        for (int64_t i = 0; i < n; i++)
+        {
+            fn();
+        }
+        t = now_ns() - start;
+        if (t > 100000000)
+            break;
+        n *= 2;
+    }
+    printf("%-32s %10.1f ns\n", name, (double) t / n);
+}
+
+static void render_clock(void)
+{
+    sink += set_7seg(frame, "12:34", colors, load);
+}
+
+static void render_temperature(void)
+{
+    sink += set_7seg(frame, "-12.5", colors, load);
+}
+
+static void render_eights(void)
+{
+    sink += set_7seg(frame, "88888888", colors, load);
+}
+
+static void blit_digit(void)
+{
+    sink += blit_7seg(frame, 1, 0x7f, digit_color);
+}
+
+static void encode_frame(void)
+{
+    sink += led_strip_encode_symbols(&encoder_config, frame, frame_size, symbols);
+}
+
+static void cache_hit(void)
+{
+    sink += symcache_get(frame)->used;
+}
+
+static void setup(int ndigits, int segleds)
+{
+    struct rgb7seg_layout l = { .digits = ndigits, .segleds = segleds, .order = "abcdefg" };
+
+    init_layout(&l);
+    apply_brightness(RGB7SEG_DEFAULT_BRIGHTNESS);
+    digit_color = led_color(colors[0]);
+    free(frame);
+    free(symbols);
+    frame = calloc(1, frame_size);
+    symbols = malloc(LED_STRIP_SYMBOLS(frame_size) * sizeof(rmt_symbol_word_t));
+    assert(frame && symbols);
+}
+
+int main(void)
+{
+    setup(4, 2);
+    printf("4 digits, 2 leds per segment, %d byte frames\n", frame_size);
+    bench("blit_7seg one digit", blit_digit);
+    bench("set_7seg \"12:34\"", render_clock);
+    bench("set_7seg \"-12.5\"", render_temperature);
+    // what a static frame costs without and with the symbol cache
+    init_symcache();
+    symcache_get(frame);
+    bench("led_strip_encode_symbols", encode_frame);
+    bench("symcache_get hit", cache_hit);
+    setup(8, 4);
+    printf("8 digits, 4 leds per segment, %d byte frames\n", frame_size);
+    bench("set_7seg \"88888888\"", render_eights);
+    return 0;
+}
@@ -0,0 +1,385 @@
+// Simulated 1-Wire bus with DS18B20 sensors, see onewire_sim.h
+#include <string.h>
+#include <math.h>
+#include "esp_timer.h"
+#include "host_idf.h"
+#include "onewire_sim.h"
+
+
+// bus state after the reset
+enum
+{
+    ROM_COMMAND,
+    MATCH_ROM,
+    SEARCH_ROM,
+    FUNCTION_COMMAND,
+    CONVERTING,
+    READ_SCRATCHPAD,
+    WRITE_SCRATCHPAD,
+    IDLE,
+};
+
+#define RESET_US    960
+#define SLOT_US     70
+
+
+// Dow-CRC one bit at a time, apart from the table driven one under test
+uint8_t ow_sim_crc8(const uint8_t *data, int len)
+{
+    uint8_t crc = 0;
+
+    for (int i = 0; i < len; i++)
+    {
+        uint8_t b = data[i];
+        for (int j = 0; j < 8; j++)
+        {
+            bool mix = (crc ^ b) & 0x01;
+            crc >>= 1;
+            if (mix)
+                crc ^= 0x8c;
+            b >>= 1;
+        }
+    }
+    return crc;
+}
+
+static void scratchpad_crc(struct ow_sim_device *d)
+{
+    d->scratchpad[8] = ow_sim_crc8(d->scratchpad, 8);
+}
+
+static int resolution(const struct ow_sim_device *d)
+{
+    return 9 + ((d->scratchpad[4] >> 5) & 0x03);
+}
+
+void ow_sim_power_up(struct ow_sim_device *d)
+{
+    static const uint8_t power_up[9] = { 0x50, 0x05, 0, 0, 0, 0xff, 0x0c, 0x10, 0 };
+
+    memcpy(d->scratchpad, power_up, sizeof(power_up));
+    memcpy(&d->scratchpad[2], d->eeprom, sizeof(d->eeprom));
+    scratchpad_crc(d);
+    d->alarm = false;
+    d->conv_done = 0;
+}
+
+void ow_sim_init(struct ow_sim *sim)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->state = IDLE;
+}
+
+struct ow_sim_device *ow_sim_add(struct ow_sim *sim, uint64_t serial, float temperature)
+{
+    struct ow_sim_device *d;
+
+    if (sim->count == OW_SIM_DEVICES)
+        return NULL;
+    d = &sim->devices[sim->count++];
+    memset(d, 0, sizeof(*d));
+    d->rom[0] = 0x28;
+    for (int i = 1; i < 7; i++)
+    {
+        d->rom[i] = serial >> (8 * (i - 1));
+    }
+    d->rom[7] = ow_sim_crc8(d->rom, 7);
+    d->eeprom[0] = 75;
+    d->eeprom[1] = 70;
+    d->eeprom[2] = 0x7f;
+    d->temperature = temperature;
+    d->present = true;
+    ow_sim_power_up(d);
+    return d;
+}
+
+// a finished conversion moves to the scratchpad, and sets the alarm flag
+// from its integer degrees
+static void settle(struct ow_sim_device *d)
+{
+    if (d->conv_done == 0 || esp_timer_get_time() < d->conv_done)
+        return;
+    d->conv_done = 0;
+    d->scratchpad[0] = d->conv_raw & 0xff;
+    d->scratchpad[1] = (uint16_t) d->conv_raw >> 8;
+    scratchpad_crc(d);
+    int whole = d->conv_raw >> 4;
+    d->alarm = whole >= (int8_t) d->scratchpad[2] || whole <= (int8_t) d->scratchpad[3];
+}
+
+static void convert(struct ow_sim_device *d)
+{
+    int res = resolution(d);
+    int16_t raw = lroundf(d->temperature * 16);
+
+    d->conv_raw = raw & ~((1 << (12 - res)) - 1);
+    d->conv_done = esp_timer_get_time() + (d->conv_us ? d->conv_us : 750000 >> (12 - res));
+}
+
+static bool rom_bit(const struct ow_sim_device *d, int bit)
+{
+    return (d->rom[bit / 8] >> (bit % 8)) & 1;
+}
+
+// the rom as the search sees it, the device takes part with the same bits
+static bool search_bit(const struct ow_sim_device *d, int bit)
+{
+    return rom_bit(d, bit) ^ (bit == 56 && (d->corrupt_crc & OW_SIM_BAD_ROM_CRC));
+}
+
+static bool scratchpad_bit(const struct ow_sim_device *d, int bit)
+{
+    return ((d->scratchpad[bit / 8] >> (bit % 8)) & 1) ^ (bit == 64 && (d->corrupt_crc & OW_SIM_BAD_SCRATCHPAD_CRC));
+}
+
+static bool conversions_done(struct ow_sim *sim)
+{
+    for (int i = 0; i < sim->count; i++)
+    {
+        struct ow_sim_device *d = &sim->devices[i];
+
+        settle(d);
+        if (d->active && d->conv_done)
+            return false;
+    }
+    return true;
+}
+
+static void rom_command(struct ow_sim *sim, uint8_t cmd)
+{
+    sim->bit = 0;
+    switch (cmd)
+    {
+        case 0x55:
+            sim->state = MATCH_ROM;
+        break;
+
+        case 0xcc:
+            sim->state = FUNCTION_COMMAND;
+        break;
+
+        case 0xec:
+            for (int i = 0; i < sim->count; i++)
+            {
+                if (!sim->devices[i].alarm)
+                    sim->devices[i].active = false;
+            }
+            sim->state = SEARCH_ROM;
+        break;
+
+        case 0xf0:
+            sim->state = SEARCH_ROM;
+        break;
+
+        default:
+            sim->state = IDLE;
+        break;
+    }
+}
+
+static void function_command(struct ow_sim *sim, uint8_t cmd)
+{
+    sim->bit = 0;
+    sim->state = IDLE;
+    memset(sim->shift, 0, sizeof(sim->shift));
+    for (int i = 0; i < sim->count; i++)
+    {
+        struct ow_sim_device *d = &sim->devices[i];
+
+        if (!d->active)
+            continue;
+        switch (cmd)
+        {
+            case 0x44:
+                convert(d);
+                sim->state = CONVERTING;
+            break;
+
+            case 0xbe:
+                sim->state = READ_SCRATCHPAD;
+            break;
+
+            case 0x4e:
+                sim->state = WRITE_SCRATCHPAD;
+            break;
+
+            case 0x48:
+                memcpy(d->eeprom, &d->scratchpad[2], sizeof(d->eeprom));
+            break;
+
+            case 0xb8:
+                memcpy(&d->scratchpad[2], d->eeprom, sizeof(d->eeprom));
+                scratchpad_crc(d);
+            break;
+        }
+    }
+    if (cmd == 0x44)
+        sim->conversions++;
+    if (cmd == 0x4e)
+        sim->scratchpad_writes++;
+}
+
+// TH, TL and configuration, the unused configuration bits read as ones
+static void write_scratchpad(struct ow_sim *sim, int index, uint8_t value)
+{
+    for (int i = 0; i < sim->count; i++)
+    {
+        struct ow_sim_device *d = &sim->devices[i];
+
+        if (!d->active)
+            continue;
+        d->scratchpad[2 + index] = (index == 2) ? (value & 0x60) | 0x1f : value;
+        scratchpad_crc(d);
+    }
+}
+
+static unsigned char sim_reset(ds18b20_bus_t *bus)
+{
+    struct ow_sim *sim = bus->ops_ctx;
+    bool presence = false;
+
+    host_advance_us(RESET_US);
+    for (int i = 0; i < sim->count; i++)
+    {
+        struct ow_sim_device *d = &sim->devices[i];
+
+        settle(d);
+        d->active = d->present;
+        presence |= d->present;
+    }
+    sim->state = ROM_COMMAND;
+    sim->bit = 0;
+    sim->shift[0] = 0;
+    return presence;
+}
+
+static void sim_write(ds18b20_bus_t *bus, char bit)
+{
+    struct ow_sim *sim = bus->ops_ctx;
+
+    bit &= 1;
+    host_advance_us(SLOT_US);
+    switch (sim->state)
+    {
+        case ROM_COMMAND:
+        case FUNCTION_COMMAND:
+            sim->shift[0] |= bit << sim->bit;
+            if (++sim->bit == 8)
+            {
+                if (sim->state == ROM_COMMAND)
+                    rom_command(sim, sim->shift[0]);
+                else
+                    function_command(sim, sim->shift[0]);
+                sim->shift[0] = 0;
+            }
+        break;
+
+        case MATCH_ROM:
+            for (int i = 0; i < sim->count; i++)
+            {
+                if (rom_bit(&sim->devices[i], sim->bit) != bit)
+                    sim->devices[i].active = false;
+            }
+            if (++sim->bit == 64)
+            {
+                sim->state = FUNCTION_COMMAND;
+                sim->bit = 0;
+            }
+        break;
+
+        // the bit and its complement were read, the master picks a branch
+        case SEARCH_ROM:
+            if (sim->bit % 3 != 2)
+            {
+                sim->state = IDLE;
+                break;
+            }
+            for (int i = 0; i < sim->count; i++)
+            {
+                if (search_bit(&sim->devices[i], sim->bit / 3) != bit)
+                    sim->devices[i].active = false;
+            }
+            if (++sim->bit == 64 * 3)
+                sim->state = IDLE;
+        break;
+
+        case WRITE_SCRATCHPAD:
+            sim->shift[sim->bit / 8] |= bit << (sim->bit % 8);
+            if (++sim->bit % 8 == 0)
+                write_scratchpad(sim, sim->bit / 8 - 1, sim->shift[sim->bit / 8 - 1]);
+            if (sim->bit == 24)
+                sim->state = IDLE;
+        break;
+    }
+}
+
+// the sensors pull the bus low for a 0, so the bus reads the and of them
+static unsigned char sim_read(ds18b20_bus_t *bus)
+{
+    struct ow_sim *sim = bus->ops_ctx;
+    unsigned char value = 1;
+
+    host_advance_us(SLOT_US);
+    switch (sim->state)
+    {
+        case SEARCH_ROM:
+            if (sim->bit % 3 == 2)
+                break;
+            for (int i = 0; i < sim->count; i++)
+            {
+                struct ow_sim_device *d = &sim->devices[i];
+
+                if (d->active)
+                    value &= search_bit(d, sim->bit / 3) ^ (sim->bit % 3);
+            }
+            sim->bit++;
+        break;
+
+        case CONVERTING:
+            value = conversions_done(sim);
+        break;
+
+        case READ_SCRATCHPAD:
+            if (sim->bit == 72)
+                break;
+            for (int i = 0; i < sim->count; i++)
+            {
+                struct ow_sim_device *d = &sim->devices[i];
+
+                if (d->active)
+                    value &= scratchpad_bit(d, sim->bit);
+            }
+            sim->bit++;
+        break;
+    }
+    return value;
+}
+
+static void sim_write_byte(ds18b20_bus_t *bus, char data)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        sim_write(bus, (data >> i) & 0x01);
+    }
+}
+
+static unsigned char sim_read_byte(ds18b20_bus_t *bus)
+{
+    unsigned char data = 0;
+
+    for (int i = 0; i < 8; i++)
+    {
+        if (sim_read(bus))
+            data |= 0x01 << i;
+    }
+    return data;
+}
+
+const struct ds18b20_bus_ops ow_sim_ops =
+{
+    .reset = sim_reset,
+    .write = sim_write,
+    .read = sim_read,
+    .write_byte = sim_write_byte,
+    .read_byte = sim_read_byte,
+};
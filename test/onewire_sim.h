@@ -0,0 +1,51 @@
+// Simulated 1-Wire bus with DS18B20 sensors for the host tests. Plugged
+// into a ds18b20 bus with ds18b20_bus_set_ops(bus, &ow_sim_ops, sim), the
+// sensors answer the reset, rom and function commands bit by bit, like on
+// the wire. Each slot moves the host clock by its bit banged time.
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "ds18b20.h"
+
+#define OW_SIM_DEVICES  16
+
+// corrupt_crc of a device, a bit of the crc byte reads flipped
+#define OW_SIM_BAD_SCRATCHPAD_CRC   0x01    // in every scratchpad read
+#define OW_SIM_BAD_ROM_CRC          0x02    // in the rom answering a search
+
+struct ow_sim_device
+{
+    uint8_t rom[8];
+    uint8_t scratchpad[9];
+    uint8_t eeprom[3];          // TH, TL and configuration at power up
+    float temperature;          // measured by the next conversion
+    int32_t conv_us;            // conversion time, 0 = 750 ms at 12 bits, halved per bit less
+    uint8_t corrupt_crc;        // OW_SIM_BAD_* flags
+    bool present;
+    bool alarm;                 // set by a conversion outside TH..TL
+    bool active;                // still selected by the rom command
+    int64_t conv_done;          // host time the conversion result is ready, 0 = none
+    int16_t conv_raw;
+};
+
+struct ow_sim
+{
+    struct ow_sim_device devices[OW_SIM_DEVICES];
+    int count;
+    // protocol state since the last reset
+    int state;
+    int bit;                    // of the command or data being sent
+    uint8_t shift[9];
+    // counted commands
+    int conversions;
+    int scratchpad_writes;
+};
+
+extern const struct ds18b20_bus_ops ow_sim_ops;
+
+void ow_sim_init(struct ow_sim *sim);
+uint8_t ow_sim_crc8(const uint8_t *data, int len);
+// adds a sensor with a DS18B20 rom of the serial number, powered up
+struct ow_sim_device *ow_sim_add(struct ow_sim *sim, uint64_t serial, float temperature);
+// back to the power up scratchpad, TH, TL and resolution from eeprom
+void ow_sim_power_up(struct ow_sim_device *d);
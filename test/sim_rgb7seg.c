@@ -0,0 +1,345 @@
+// Display simulator on the host. rgb7seg runs a scripted show through the
+// rmt backend and the led strip encoder, every transmission is decoded
+// back to pixels with the WS2812 timing checked, and compared with the
+// frame which was meant to be sent. Frames can be printed with ansi colors
+// or written as PPM images.
+//
+//   rgb7seg_sim [-a] [-o dir] [-v]
+//     -a      print the frames on the terminal
+//     -o dir  write each frame to dir/frame-NNNN.ppm
+//     -v      info logs of the display code
+//
+// Exits nonzero if a frame does not decode back to what was rendered, or
+// if the display does not recover from a lost done interrupt.
+#include <unistd.h>
+#include "rgb7seg.c"
+#include "host_idf.h"
+
+
+// one digit in the image, segments are 2 pixels thick
+#define CELL_W      14
+#define CELL_H      22
+#define SCALE       4
+#define DARK_LED    28      // unlit segments are drawn dark gray
+
+struct rect
+{
+    int x, y, w, h;
+};
+
+// segments a..g inside a cell
+static const struct rect segment_rects[SEGMENTS] =
+{
+    { 3, 1, 8, 2 },     // a
+    { 11, 3, 2, 8 },    // b
+    { 11, 12, 2, 8 },   // c
+    { 3, 20, 8, 2 },    // d
+    { 1, 12, 2, 8 },    // e
+    { 1, 3, 2, 8 },     // f
+    { 3, 10, 8, 2 },    // g
+};
+
+static bool ansi;
+static const char *ppm_dir;
+static uint8_t *decoded;
+static uint8_t *image;
+static int image_w, image_h;
+static int frames, symbols_sent, errors;
+
+
+// decoded wire order bytes back to rgb, scaled up so that dimmed leds show
+static struct color decoded_color(int led)
+{
+    const uint8_t *w = &decoded[led * 3];
+    struct color c;
+
+#if CONFIG_RGB7SEG_COLOR_ORDER_GRB
+    c = (struct color) { w[1], w[0], w[2] };
+#elif CONFIG_RGB7SEG_COLOR_ORDER_BRG
+    c = (struct color) { w[1], w[2], w[0] };
+#else
+    c = (struct color) { w[0], w[1], w[2] };
+#endif
+    int max = c.r > c.g ? c.r : c.g;
+    if (c.b > max) max = c.b;
+    if (max == 0)
+        return (struct color) { DARK_LED, DARK_LED, DARK_LED };
+    c.r = c.r * 255 / max;
+    c.g = c.g * 255 / max;
+    c.b = c.b * 255 / max;
+    return c;
+}
+
+static void fill(struct rect r, int x0, struct color c)
+{
+    for (int y = r.y * SCALE; y < (r.y + r.h) * SCALE; y++)
+    {
+        for (int x = (x0 + r.x) * SCALE; x < (x0 + r.x + r.w) * SCALE; x++)
+        {
+            uint8_t *p = &image[(y * image_w + x) * 3];
+            p[0] = c.r;
+            p[1] = c.g;
+            p[2] = c.b;
+        }
+    }
+}
+
+// each led of a segment gets its own part of the segment
+static void draw_segment(int digit, int s)
+{
+    struct rect r = segment_rects[s];
+    bool horizontal = r.w > r.h;
+    int len = horizontal ? r.w : r.h;
+
+    for (int k = 0; k < layout.segleds; k++)
+    {
+        struct rect part = r;
+        int from = len * k / layout.segleds, to = len * (k + 1) / layout.segleds;
+
+        if (horizontal)
+        {
+            part.x += from;
+            part.w = to - from;
+        }
+        else
+        {
+            part.y += from;
+            part.h = to - from;
+        }
+        fill(part, digit * CELL_W, decoded_color(digit * digit_leds + seg_map[s] + k));
+    }
+}
+
+static void write_ppm(void)
+{
+    char path[512];
+    FILE *f;
+
+    memset(image, 0, image_w * image_h * 3);
+    for (int d = 0; d < digits; d++)
+    {
+        for (int s = 0; s < SEGMENTS; s++)
+        {
+            draw_segment(d, s);
+        }
+    }
+    fill((struct rect) { 1, 6, 2, 2 }, digits * CELL_W, decoded_color(indicator_led + RGB7SEG_COLON));
+    fill((struct rect) { 1, 14, 2, 2 }, digits * CELL_W, decoded_color(indicator_led + RGB7SEG_COLON));
+    fill((struct rect) { 1, 20, 2, 2 }, digits * CELL_W, decoded_color(indicator_led + RGB7SEG_DP));
+
+    snprintf(path, sizeof(path), "%s/frame-%04d.ppm", ppm_dir, frames);
+    f = fopen(path, "wb");
+    if (f == NULL)
+    {
+        perror(path);
+        exit(2);
+    }
+    fprintf(f, "P6\n%d %d\n255\n", image_w, image_h);
+    fwrite(image, 3, image_w * image_h, f);
+    fclose(f);
+}
+
+// same shapes as the console backend, from the decoded leds
+static void ansi_led(int led, char ch)
+{
+    struct color c = decoded_color(led);
+
+    if (c.r == DARK_LED && c.g == DARK_LED && c.b == DARK_LED)
+        putchar(' ');
+    else
+        printf("\033[38;2;%d;%d;%dm%c", c.r, c.g, c.b, ch);
+}
+
+static void print_ansi(int panel)
+{
+    static const int8_t rows[3][3] = {
+        { -1, 0, -1 },
+        { 5, 6, 1 },
+        { 4, 3, 2 },
+    };
+    static const char shapes[3][3] = {
+        { ' ', '_', ' ' },
+        { '|', '_', '|' },
+        { '|', '_', '|' },
+    };
+
+    for (int row = 0; row < 3; row++)
+    {
+        if (row == 0)
+            printf("%8.3fs %d ", esp_timer_get_time() / 1e6, panel);
+        else
+            printf("%9s %d ", "", panel);
+        for (int d = 0; d < digits; d++)
+        {
+            for (int col = 0; col < 3; col++)
+            {
+                int s = rows[row][col];
+                if (s < 0)
+                    putchar(' ');
+                else
+                    ansi_led(d * digit_leds + seg_map[s], shapes[row][col]);
+            }
+        }
+        if (row == 1)
+            ansi_led(indicator_led + RGB7SEG_COLON, ':');
+        if (row == 2)
+            ansi_led(indicator_led + RGB7SEG_DP, '.');
+        printf("\033[0m\n");
+    }
+}
+
+// called from rmt_transmit() with the symbols which went to the strip
+static void frame_on_wire(int gpio, const rmt_symbol_word_t *symbols, size_t num_symbols)
+{
+    int panel = -1;
+
+    for (int i = 0; i < RGB7SEG_PANELS; i++)
+    {
+        if (panel_gpios[i] == gpio)
+            panel = i;
+    }
+    frames++;
+    symbols_sent += num_symbols;
+    memset(decoded, 0, frame_size);
+    if (led_strip_decode_symbols(&encoder_config, symbols, num_symbols, decoded, frame_size) != frame_size)
+    {
+        fprintf(stderr, "frame %d on gpio %d: symbols do not decode to a frame\n", frames, gpio);
+        errors++;
+        return;
+    }
+#if CONFIG_RGB7SEG_DITHER
+    // the refresh sends the prepared frame, the next one is prepared after it
+    const uint8_t *sent = panel < 0 ? NULL : panels[panel].dither_out[panels[panel].dither_next];
+#else
+    const uint8_t *sent = panel < 0 ? NULL : panels[panel].framebuffers[panels[panel].back ^ 1];
+#endif
+    if (sent == NULL || memcmp(decoded, sent, frame_size))
+    {
+        fprintf(stderr, "frame %d on gpio %d: decoded frame differs from the rendered one\n", frames, gpio);
+        errors++;
+    }
+    if (ansi)
+        print_ansi(panel);
+    if (ppm_dir)
+        write_ppm();
+}
+
+// runs the display task on the events of the next us
+static void run(int64_t us)
+{
+    int64_t end = esp_timer_get_time() + us;
+
+    for (;;)
+    {
+        uint32_t events = host_take_notify(display_task_handle);
+
+        if (events)
+            display_events(events);
+        else if (!host_run_next_timer(end))
+            break;
+    }
+    host_advance_us(end - esp_timer_get_time());
+}
+
+static void show(void)
+{
+    static const struct color white = { 255, 255, 255 };
+    static const struct color sky = { 0, 222, 255 };
+    static const struct color gold = { 255, 236, 0 };
+    static const struct color red = { 255, 0, 0 };
+    static const struct color blue = { 0, 0, 255 };
+
+    rgb7seg_display(0, "12:34", white, RGB7SEG_SRC_MAIN);
+    run(100000);
+    rgb7seg_set_indicator(RGB7SEG_COLON, NULL, true);
+    run(1200000);
+    rgb7seg_set_indicator(RGB7SEG_COLON, NULL, false);
+    rgb7seg_animate(0, "-5.2", sky, RGB7SEG_SRC_MQTT, RGB7SEG_FADE, 500);
+    run(700000);
+    rgb7seg_animate(0, "23.4", gold, RGB7SEG_SRC_MQTT, RGB7SEG_SLIDE, 400);
+    run(600000);
+    rgb7seg_animate(0, "23.5", gold, RGB7SEG_SRC_MQTT, RGB7SEG_PULSE, 400);
+    run(600000);
+    rgb7seg_display_gradient(0, "8888", red, blue, RGB7SEG_SRC_MAIN);
+    run(100000);
+    rgb7seg_set_brightness(255);
+    rgb7seg_display(0, "8.8.8.8.", white, RGB7SEG_SRC_MAIN);
+    run(100000);
+    rgb7seg_set_brightness(RGB7SEG_DEFAULT_BRIGHTNESS);
+    rgb7seg_marquee(0, "hello world", gold, RGB7SEG_SRC_WIFI, 150, 1);
+    run(3000000);
+    rgb7seg_display(0, "12:34", white, RGB7SEG_SRC_MAIN);
+    run(100000);
+}
+
+// the done interrupt of one round gets lost while an animation ticks, the
+// display task has to end the round by itself and go on sending
+static void lost_done(void)
+{
+    static const struct color green = { 0, 255, 0 };
+    int sent;
+
+    rgb7seg_animate(0, "42.0", green, RGB7SEG_SRC_MQTT, RGB7SEG_FADE, 1000);
+    host_rmt_drop_done = 1;
+    run(50000);
+    sent = frames;
+    run(TX_DONE_TIMEOUT_MS * 1000 + 200000);
+    if (host_rmt_drop_done || frames == sent || tx_busy)
+    {
+        fprintf(stderr, "display stuck after a lost done interrupt\n");
+        errors++;
+    }
+    run(1000000);
+}
+
+int main(int argc, char **argv)
+{
+    struct rgb7seg_layout l;
+    struct rgb7seg_stats *st;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "ao:v")) != -1)
+    {
+        switch (opt)
+        {
+            case 'a':
+                ansi = true;
+            break;
+
+            case 'o':
+                ppm_dir = optarg;
+            break;
+
+            case 'v':
+                host_log_level = ESP_LOG_INFO;
+            break;
+
+            default:
+                fprintf(stderr, "usage: %s [-a] [-o dir] [-v]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    rgb7seg_default_layout(&l);
+    rgb7seg_init(&l);
+    decoded = malloc(frame_size);
+    image_w = (digits * CELL_W + 4) * SCALE;
+    image_h = (CELL_H + 1) * SCALE;
+    image = malloc(image_w * image_h * 3);
+    assert(decoded && image);
+    host_rmt_sent = frame_on_wire;
+
+    show();
+    lost_done();
+
+    st = rgb7seg_getstats();
+    printf("%d frames, %d symbols, %lu skipped, %lu animation frames, %lu cache hits, %lu misses\n",
+        frames, symbols_sent, (unsigned long) st->skipped, (unsigned long) st->animframes,
+        (unsigned long) st->cachehits, (unsigned long) st->cachemisses);
+    if (frames == 0 || errors)
+    {
+        fprintf(stderr, "%d bad frames\n", errors);
+        return 1;
+    }
+    return 0;
+}
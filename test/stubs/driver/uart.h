@@ -0,0 +1,2 @@
+#pragma once
+// the uart 1-Wire backend is not built on the host
@@ -0,0 +1,5 @@
+#pragma once
+#include <stdint.h>
+
+// busy wait, moves the simulated clock
+void ets_delay_us(uint32_t us);
@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include "esp_attr.h"
+#include "esp_err.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              pdTRUE
+#define pdFAIL              pdFALSE
+#define portMAX_DELAY       ((TickType_t) 0xffffffff)
+#define portTICK_PERIOD_MS  10
+#define pdMS_TO_TICKS(ms)   ((TickType_t) (ms) / portTICK_PERIOD_MS)
+
+// there is only one thread on the host, critical sections are empty
+typedef struct
+{
+    int owner;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+#define taskENTER_CRITICAL(mux)     ((void) (mux))
+#define taskEXIT_CRITICAL(mux)      ((void) (mux))
+#define portENTER_CRITICAL(mux)     ((void) (mux))
+#define portEXIT_CRITICAL(mux)      ((void) (mux))
+#define portYIELD_FROM_ISR(woken)   ((void) (woken))
@@ -0,0 +1,10 @@
+#pragma once
+#include "freertos/queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+#define xSemaphoreCreateBinary()                xQueueCreate(1, 0)
+#define xSemaphoreTake(sem, ticks)              xQueueReceive(sem, NULL, ticks)
+#define xSemaphoreGive(sem)                     xQueueSend(sem, NULL, 0)
+#define xSemaphoreGiveFromISR(sem, woken)       xQueueSendFromISR(sem, NULL, woken)
+#define vSemaphoreDelete(sem)                   vQueueDelete(sem)
@@ -0,0 +1,67 @@
+// Blobs of main/flashmem.c kept in memory, one store for all handles
+#include <stdbool.h>
+#include <string.h>
+#include "flashmem.h"
+#include "host_idf.h"
+
+
+#define BLOBS       8
+#define BLOB_SIZE   256
+
+struct blob
+{
+    char name[16];
+    uint8_t value[BLOB_SIZE];
+    size_t len;
+};
+
+static struct blob blobs[BLOBS];
+static int blob_count;
+int host_flash_commits;
+
+
+void host_flash_clear(void)
+{
+    blob_count = 0;
+    host_flash_commits = 0;
+}
+
+static struct blob *blob_find(const char *name)
+{
+    for (int i = 0; i < blob_count; i++)
+    {
+        if (!strcmp(blobs[i].name, name))
+            return &blobs[i];
+    }
+    return NULL;
+}
+
+bool flash_read_blob(nvs_handle nvsh, char *name, void *value, size_t len)
+{
+    struct blob *b = blob_find(name);
+
+    if (b == NULL || b->len != len)
+        return false;
+    memcpy(value, b->value, len);
+    return true;
+}
+
+void flash_write_blob(nvs_handle nvsh, char *name, const void *value, size_t len)
+{
+    struct blob *b = blob_find(name);
+
+    if (b == NULL)
+    {
+        if (blob_count == BLOBS || strlen(name) >= sizeof(b->name) || len > BLOB_SIZE)
+            return;
+        b = &blobs[blob_count++];
+        strcpy(b->name, name);
+    }
+    memcpy(b->value, value, len);
+    b->len = len;
+}
+
+void flash_commitchanges(nvs_handle nvsh)
+{
+    host_flash_commits++;
+}
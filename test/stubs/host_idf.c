@@ -0,0 +1,803 @@
+// Host versions of the esp-idf and FreeRTOS calls used by main/, on a
+// simulated clock.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "driver/rmt_tx.h"
+#include "driver/gptimer.h"
+#include "driver/gpio.h"
+#include "esp32/rom/ets_sys.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "host_idf.h"
+
+
+esp_log_level_t host_log_level = ESP_LOG_ERROR;
+host_rmt_sent_t host_rmt_sent;
+int host_rmt_fail;
+int host_rmt_drop_done;
+int host_rmt_sync_resets;
+
+static int64_t now_us;
+
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+        case ESP_OK:                return "ESP_OK";
+        case ESP_ERR_NO_MEM:        return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:   return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:  return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:     return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_TIMEOUT:       return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_CRC:   return "ESP_ERR_INVALID_CRC";
+        default:                    return "ESP_FAIL";
+    }
+}
+
+void esp_restart(void)
+{
+    fprintf(stderr, "esp_restart() called\n");
+    abort();
+}
+
+
+// esp_timer and gptimer alarms are kept in one list
+struct host_timer
+{
+    void (*fire)(struct host_timer *t);
+    int64_t period;   // 0 = one shot
+    int64_t expiry;
+    bool active;
+    struct host_timer *next;
+};
+
+static struct host_timer *timers;
+
+static void timer_add(struct host_timer *t)
+{
+    t->next = timers;
+    timers = t;
+}
+
+static void timer_remove(struct host_timer *t)
+{
+    for (struct host_timer **pp = &timers; *pp; pp = &(*pp)->next)
+    {
+        if (*pp == t)
+        {
+            *pp = t->next;
+            return;
+        }
+    }
+}
+
+static void timer_start(struct host_timer *t, int64_t timeout, bool periodic)
+{
+    t->period = periodic ? timeout : 0;
+    t->expiry = now_us + timeout;
+    t->active = true;
+}
+
+bool host_run_next_timer(int64_t limit)
+{
+    struct host_timer *first = NULL;
+
+    for (struct host_timer *t = timers; t; t = t->next)
+    {
+        if (t->active && (first == NULL || t->expiry < first->expiry))
+            first = t;
+    }
+    if (first == NULL || first->expiry > limit)
+        return false;
+    if (first->expiry > now_us)
+        now_us = first->expiry;
+    if (first->period > 0)
+        first->expiry += first->period;
+    else
+        first->active = false;
+    first->fire(first);
+    return true;
+}
+
+void host_advance_us(int64_t us)
+{
+    int64_t end = now_us + us;
+
+    while (host_run_next_timer(end))
+        ;
+    now_us = end;
+}
+
+// lets time pass until ready() or the timeout, false on timeout
+static bool host_wait(bool (*ready)(void *arg), void *arg, TickType_t ticks)
+{
+    int64_t deadline = (ticks == portMAX_DELAY) ? INT64_MAX : now_us + (int64_t) ticks * portTICK_PERIOD_MS * 1000;
+
+    while (!ready(arg))
+    {
+        if (!host_run_next_timer(deadline))
+        {
+            if (deadline != INT64_MAX)
+                now_us = deadline;
+            return ready(arg);
+        }
+    }
+    return true;
+}
+
+
+struct esp_timer
+{
+    struct host_timer timer;
+    esp_timer_create_args_t args;
+};
+
+static void esp_timer_fire(struct host_timer *t)
+{
+    struct esp_timer *et = (struct esp_timer *) t;
+
+    et->args.callback(et->args.arg);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    struct esp_timer *et = calloc(1, sizeof(struct esp_timer));
+
+    if (et == NULL)
+        return ESP_ERR_NO_MEM;
+    et->args = *create_args;
+    et->timer.fire = esp_timer_fire;
+    timer_add(&et->timer);
+    *out_handle = et;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    if (timer->timer.active)
+        return ESP_ERR_INVALID_STATE;
+    timer_start(&timer->timer, timeout_us, false);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    if (timer->timer.active)
+        return ESP_ERR_INVALID_STATE;
+    if (period == 0)
+        return ESP_ERR_INVALID_ARG;
+    timer_start(&timer->timer, period, true);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!timer->timer.active)
+        return ESP_ERR_INVALID_STATE;
+    timer->timer.active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (timer->timer.active)
+        return ESP_ERR_INVALID_STATE;
+    timer_remove(&timer->timer);
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer->timer.active;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return now_us;
+}
+
+
+struct gptimer_t
+{
+    struct host_timer timer;
+    uint32_t resolution_hz;
+    gptimer_alarm_config_t alarm;
+    gptimer_alarm_cb_t on_alarm;
+    void *user_ctx;
+    bool enabled;
+};
+
+static void gptimer_fire(struct host_timer *t)
+{
+    struct gptimer_t *gt = (struct gptimer_t *) t;
+    gptimer_alarm_event_data_t edata = {
+        .count_value = gt->alarm.alarm_count,
+        .alarm_value = gt->alarm.alarm_count,
+    };
+
+    if (gt->on_alarm)
+        gt->on_alarm(gt, &edata, gt->user_ctx);
+}
+
+esp_err_t gptimer_new_timer(const gptimer_config_t *config, gptimer_handle_t *ret_timer)
+{
+    struct gptimer_t *gt = calloc(1, sizeof(struct gptimer_t));
+
+    if (gt == NULL)
+        return ESP_ERR_NO_MEM;
+    if (config->resolution_hz == 0)
+    {
+        free(gt);
+        return ESP_ERR_INVALID_ARG;
+    }
+    gt->resolution_hz = config->resolution_hz;
+    gt->timer.fire = gptimer_fire;
+    timer_add(&gt->timer);
+    *ret_timer = gt;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_register_event_callbacks(gptimer_handle_t timer, const gptimer_event_callbacks_t *cbs, void *user_data)
+{
+    if (timer->enabled)
+        return ESP_ERR_INVALID_STATE;
+    timer->on_alarm = cbs->on_alarm;
+    timer->user_ctx = user_data;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_set_alarm_action(gptimer_handle_t timer, const gptimer_alarm_config_t *config)
+{
+    timer->alarm = *config;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_enable(gptimer_handle_t timer)
+{
+    if (timer->enabled)
+        return ESP_ERR_INVALID_STATE;
+    timer->enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_start(gptimer_handle_t timer)
+{
+    if (!timer->enabled || timer->timer.active)
+        return ESP_ERR_INVALID_STATE;
+    timer_start(&timer->timer, timer->alarm.alarm_count * 1000000 / timer->resolution_hz,
+        timer->alarm.flags.auto_reload_on_alarm);
+    return ESP_OK;
+}
+
+esp_err_t gptimer_stop(gptimer_handle_t timer)
+{
+    if (!timer->timer.active)
+        return ESP_ERR_INVALID_STATE;
+    timer->timer.active = false;
+    return ESP_OK;
+}
+
+
+void ets_delay_us(uint32_t us)
+{
+    host_advance_us(us);
+}
+
+
+struct host_task
+{
+    TaskFunction_t fn;
+    void *arg;
+    uint32_t value;
+    bool notified;
+};
+
+// the caller of all blocking functions, the test itself
+static struct host_task main_task;
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t *handle)
+{
+    struct host_task *task = calloc(1, sizeof(struct host_task));
+
+    if (task == NULL)
+        return pdFAIL;
+    task->fn = fn;
+    task->arg = arg;
+    if (handle)
+        *handle = task;
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task && task != &main_task)
+        free(task);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return &main_task;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    host_advance_us((int64_t) ticks * portTICK_PERIOD_MS * 1000);
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    if (task == NULL)
+        return pdFAIL;
+    switch (action)
+    {
+        case eNoAction:
+        break;
+
+        case eSetBits:
+            task->value |= value;
+        break;
+
+        case eIncrement:
+            task->value++;
+        break;
+
+        case eSetValueWithOverwrite:
+            task->value = value;
+        break;
+
+        case eSetValueWithoutOverwrite:
+            if (task->notified)
+                return pdFAIL;
+            task->value = value;
+        break;
+    }
+    task->notified = true;
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *woken)
+{
+    if (woken)
+        *woken = pdTRUE;
+    return xTaskNotify(task, value, action);
+}
+
+static bool task_notified(void *arg)
+{
+    return ((struct host_task *) arg)->notified;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t ticks)
+{
+    struct host_task *task = &main_task;
+
+    if (!task->notified)
+        task->value &= ~clear_on_entry;
+    if (!host_wait(task_notified, task, ticks))
+        return pdFALSE;
+    if (value)
+        *value = task->value;
+    task->value &= ~clear_on_exit;
+    task->notified = false;
+    return pdTRUE;
+}
+
+uint32_t host_take_notify(TaskHandle_t task)
+{
+    uint32_t value = task->value;
+
+    task->value = 0;
+    task->notified = false;
+    return value;
+}
+
+
+struct host_queue
+{
+    size_t length;
+    size_t item_size;
+    size_t head;
+    size_t count;
+    uint8_t *items;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue *q = calloc(1, sizeof(struct host_queue));
+
+    if (q == NULL)
+        return NULL;
+    q->length = length;
+    q->item_size = item_size;
+    q->items = calloc(length, item_size ? item_size : 1);
+    if (q->items == NULL)
+    {
+        free(q);
+        return NULL;
+    }
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    free(queue->items);
+    free(queue);
+}
+
+static void queue_put(QueueHandle_t q, size_t slot, const void *item)
+{
+    if (q->item_size)
+        memcpy(&q->items[slot * q->item_size], item, q->item_size);
+}
+
+// nothing else runs while the test sends, a full queue stays full
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    if (queue->count == queue->length)
+        return pdFAIL;
+    queue_put(queue, (queue->head + queue->count) % queue->length, item);
+    queue->count++;
+    return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken)
+{
+    return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item)
+{
+    queue_put(queue, queue->head, item);
+    queue->count = 1;
+    return pdPASS;
+}
+
+static bool queue_ready(void *arg)
+{
+    return ((struct host_queue *) arg)->count > 0;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    if (!host_wait(queue_ready, queue, ticks))
+        return pdFALSE;
+    if (queue->item_size)
+        memcpy(item, &queue->items[queue->head * queue->item_size], queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return queue->count;
+}
+
+
+esp_err_t gpio_set_direction(gpio_num_t gpio, gpio_mode_t mode)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level)
+{
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio)
+{
+    return 1;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio, gpio_pull_mode_t pull)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio)
+{
+    return ESP_OK;
+}
+
+void esp_rom_gpio_pad_select_gpio(uint32_t gpio)
+{
+}
+
+
+// Channel memory is one block of symbols. An encoder which fills it returns
+// MEM_FULL, the block is sent and the encoder is called again, like from
+// the rmt interrupt on the device.
+struct rmt_channel_t
+{
+    int gpio;
+    bool enabled;
+    rmt_tx_done_callback_t on_trans_done;
+    void *user_ctx;
+    rmt_symbol_word_t *block;
+    size_t block_symbols;
+    size_t block_used;
+    rmt_symbol_word_t *frame;     // all symbols of the transmission
+    size_t frame_len;
+    size_t frame_cap;
+};
+
+struct rmt_sync_manager_t
+{
+    size_t channels;
+};
+
+esp_err_t rmt_new_tx_channel(const rmt_tx_channel_config_t *config, rmt_channel_handle_t *ret_chan)
+{
+    struct rmt_channel_t *chan = calloc(1, sizeof(struct rmt_channel_t));
+
+    if (chan == NULL)
+        return ESP_ERR_NO_MEM;
+    chan->gpio = config->gpio_num;
+    chan->block_symbols = config->mem_block_symbols ? config->mem_block_symbols : 64;
+    chan->block = calloc(chan->block_symbols, sizeof(rmt_symbol_word_t));
+    if (chan->block == NULL)
+    {
+        free(chan);
+        return ESP_ERR_NO_MEM;
+    }
+    *ret_chan = chan;
+    return ESP_OK;
+}
+
+esp_err_t rmt_del_channel(rmt_channel_handle_t chan)
+{
+    if (chan->enabled)
+        return ESP_ERR_INVALID_STATE;
+    free(chan->block);
+    free(chan->frame);
+    free(chan);
+    return ESP_OK;
+}
+
+esp_err_t rmt_tx_register_event_callbacks(rmt_channel_handle_t chan, const rmt_tx_event_callbacks_t *cbs, void *user_data)
+{
+    if (chan->enabled)
+        return ESP_ERR_INVALID_STATE;
+    chan->on_trans_done = cbs->on_trans_done;
+    chan->user_ctx = user_data;
+    return ESP_OK;
+}
+
+esp_err_t rmt_enable(rmt_channel_handle_t chan)
+{
+    if (chan->enabled)
+        return ESP_ERR_INVALID_STATE;
+    chan->enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t rmt_disable(rmt_channel_handle_t chan)
+{
+    if (!chan->enabled)
+        return ESP_ERR_INVALID_STATE;
+    chan->enabled = false;
+    return ESP_OK;
+}
+
+// false when the channel memory is full
+static bool rmt_put(rmt_channel_handle_t chan, rmt_symbol_word_t symbol)
+{
+    if (chan->block_used == chan->block_symbols)
+        return false;
+    chan->block[chan->block_used++] = symbol;
+    return true;
+}
+
+static void rmt_flush(rmt_channel_handle_t chan)
+{
+    if (chan->frame_len + chan->block_used > chan->frame_cap)
+    {
+        chan->frame_cap = (chan->frame_len + chan->block_used) * 2;
+        chan->frame = realloc(chan->frame, chan->frame_cap * sizeof(rmt_symbol_word_t));
+        if (chan->frame == NULL)
+            abort();
+    }
+    memcpy(&chan->frame[chan->frame_len], chan->block, chan->block_used * sizeof(rmt_symbol_word_t));
+    chan->frame_len += chan->block_used;
+    chan->block_used = 0;
+}
+
+esp_err_t rmt_transmit(rmt_channel_handle_t chan, rmt_encoder_handle_t encoder, const void *payload, size_t payload_bytes, const rmt_transmit_config_t *config)
+{
+    rmt_encode_state_t state;
+
+    if (!chan->enabled)
+        return ESP_ERR_INVALID_STATE;
+    if (host_rmt_fail > 0)
+    {
+        host_rmt_fail--;
+        return ESP_FAIL;
+    }
+    chan->frame_len = 0;
+    chan->block_used = 0;
+    encoder->reset(encoder);
+    do
+    {
+        size_t before = chan->frame_len;
+
+        encoder->encode(encoder, chan, payload, payload_bytes, &state);
+        rmt_flush(chan);
+        if (!(state & RMT_ENCODING_COMPLETE) && chan->frame_len == before)
+        {
+            fprintf(stderr, "rmt encoder makes no progress\n");
+            abort();
+        }
+    } while (!(state & RMT_ENCODING_COMPLETE));
+
+    if (host_rmt_sent)
+        host_rmt_sent(chan->gpio, chan->frame, chan->frame_len);
+    if (host_rmt_drop_done > 0)
+    {
+        host_rmt_drop_done--;
+    }
+    else if (chan->on_trans_done)
+    {
+        rmt_tx_done_event_data_t edata = {
+            .num_symbols = chan->frame_len,
+        };
+        chan->on_trans_done(chan, &edata, chan->user_ctx);
+    }
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_sync_manager(const rmt_sync_manager_config_t *config, rmt_sync_manager_handle_t *ret_synchro)
+{
+    struct rmt_sync_manager_t *synchro = calloc(1, sizeof(struct rmt_sync_manager_t));
+
+    if (synchro == NULL)
+        return ESP_ERR_NO_MEM;
+    synchro->channels = config->array_size;
+    *ret_synchro = synchro;
+    return ESP_OK;
+}
+
+esp_err_t rmt_sync_reset(rmt_sync_manager_handle_t synchro)
+{
+    host_rmt_sync_resets++;
+    return ESP_OK;
+}
+
+
+void *rmt_alloc_encoder_mem(size_t size)
+{
+    return calloc(1, size);
+}
+
+esp_err_t rmt_del_encoder(rmt_encoder_handle_t encoder)
+{
+    return encoder->del(encoder);
+}
+
+esp_err_t rmt_encoder_reset(rmt_encoder_handle_t encoder)
+{
+    return encoder->reset(encoder);
+}
+
+// bytes encoder, resumes where the channel memory filled up
+typedef struct
+{
+    rmt_encoder_t base;
+    rmt_symbol_word_t bit0;
+    rmt_symbol_word_t bit1;
+    bool msb_first;
+    size_t byte;
+    int bit;
+} host_bytes_encoder_t;
+
+static size_t host_bytes_encode(rmt_encoder_t *encoder, rmt_channel_handle_t chan, const void *data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    host_bytes_encoder_t *enc = __containerof(encoder, host_bytes_encoder_t, base);
+    const uint8_t *bytes = data;
+    size_t encoded = 0;
+
+    for (; enc->byte < data_size; encoded++)
+    {
+        int shift = enc->msb_first ? 7 - enc->bit : enc->bit;
+        rmt_symbol_word_t symbol = ((bytes[enc->byte] >> shift) & 1) ? enc->bit1 : enc->bit0;
+
+        if (!rmt_put(chan, symbol))
+        {
+            *ret_state = RMT_ENCODING_MEM_FULL;
+            return encoded;
+        }
+        if (++enc->bit == 8)
+        {
+            enc->bit = 0;
+            enc->byte++;
+        }
+    }
+    enc->byte = 0;
+    *ret_state = RMT_ENCODING_COMPLETE;
+    return encoded;
+}
+
+static esp_err_t host_bytes_reset(rmt_encoder_t *encoder)
+{
+    host_bytes_encoder_t *enc = __containerof(encoder, host_bytes_encoder_t, base);
+
+    enc->byte = 0;
+    enc->bit = 0;
+    return ESP_OK;
+}
+
+static esp_err_t host_encoder_del(rmt_encoder_t *encoder)
+{
+    free(encoder);
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_bytes_encoder(const rmt_bytes_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    host_bytes_encoder_t *enc = calloc(1, sizeof(host_bytes_encoder_t));
+
+    if (enc == NULL)
+        return ESP_ERR_NO_MEM;
+    enc->base.encode = host_bytes_encode;
+    enc->base.reset = host_bytes_reset;
+    enc->base.del = host_encoder_del;
+    enc->bit0 = config->bit0;
+    enc->bit1 = config->bit1;
+    enc->msb_first = config->flags.msb_first;
+    *ret_encoder = &enc->base;
+    return ESP_OK;
+}
+
+// copy encoder, data is rmt symbols
+typedef struct
+{
+    rmt_encoder_t base;
+    size_t symbol;
+} host_copy_encoder_t;
+
+static size_t host_copy_encode(rmt_encoder_t *encoder, rmt_channel_handle_t chan, const void *data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    host_copy_encoder_t *enc = __containerof(encoder, host_copy_encoder_t, base);
+    const rmt_symbol_word_t *symbols = data;
+    size_t encoded = 0;
+
+    for (; enc->symbol < data_size / sizeof(rmt_symbol_word_t); enc->symbol++, encoded++)
+    {
+        if (!rmt_put(chan, symbols[enc->symbol]))
+        {
+            *ret_state = RMT_ENCODING_MEM_FULL;
+            return encoded;
+        }
+    }
+    enc->symbol = 0;
+    *ret_state = RMT_ENCODING_COMPLETE;
+    return encoded;
+}
+
+static esp_err_t host_copy_reset(rmt_encoder_t *encoder)
+{
+    host_copy_encoder_t *enc = __containerof(encoder, host_copy_encoder_t, base);
+
+    enc->symbol = 0;
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_copy_encoder(const rmt_copy_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    host_copy_encoder_t *enc = calloc(1, sizeof(host_copy_encoder_t));
+
+    if (enc == NULL)
+        return ESP_ERR_NO_MEM;
+    enc->base.encode = host_copy_encode;
+    enc->base.reset = host_copy_reset;
+    enc->base.del = host_encoder_del;
+    *ret_encoder = &enc->base;
+    return ESP_OK;
+}
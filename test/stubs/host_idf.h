@@ -0,0 +1,29 @@
+// Control of the simulated esp-idf from the host tests. Time moves only
+// when the test advances it or a call blocks, the timers which expire on
+// the way are run in order.
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/rmt_tx.h"
+
+// moves the clock, running the timers which expire until then
+void host_advance_us(int64_t us);
+// runs the first timer expiring at or before limit, false if there is none
+bool host_run_next_timer(int64_t limit);
+// notification bits of the task, cleared
+uint32_t host_take_notify(TaskHandle_t task);
+
+// symbols of every transmission, gpio tells the channel
+typedef void (*host_rmt_sent_t)(int gpio, const rmt_symbol_word_t *symbols, size_t num_symbols);
+extern host_rmt_sent_t host_rmt_sent;
+// number of the next rmt_transmit() calls to fail with ESP_FAIL
+extern int host_rmt_fail;
+// number of the next rmt_transmit() calls which send without a done callback
+extern int host_rmt_drop_done;
+extern int host_rmt_sync_resets;
+
+// flash_*_blob() of flashmem.h keep the blobs in memory until cleared
+void host_flash_clear(void);
+extern int host_flash_commits;
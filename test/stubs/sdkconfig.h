@@ -0,0 +1,36 @@
+// Configuration of the host builds, same as the sdkconfig of the device.
+// Test targets change single options with compile definitions.
+#pragma once
+
+#ifndef CONFIG_LEDSTRIP_GPIO
+#define CONFIG_LEDSTRIP_GPIO 0
+#endif
+#ifndef CONFIG_RGB7SEG_PANELS
+#define CONFIG_RGB7SEG_PANELS 1
+#endif
+#define CONFIG_RGB7SEG_PANEL1_GPIO 2
+#define CONFIG_RGB7SEG_PANEL2_GPIO 4
+#define CONFIG_RGB7SEG_PANEL3_GPIO 5
+#define CONFIG_RGB7SEG_DIGITS 4
+#define CONFIG_RGB7SEG_SEGMENT_LEDS 2
+#define CONFIG_RGB7SEG_SEGMENT_ORDER "abcdefg"
+#if !CONFIG_RGB7SEG_COLOR_ORDER_GRB && !CONFIG_RGB7SEG_COLOR_ORDER_BRG
+#define CONFIG_RGB7SEG_COLOR_ORDER_RGB 1
+#endif
+#define CONFIG_RGB7SEG_UA_PER_STEP 78
+#ifndef CONFIG_RGB7SEG_CURRENT_BUDGET_MA
+#define CONFIG_RGB7SEG_CURRENT_BUDGET_MA 400
+#endif
+#define CONFIG_RGB7SEG_ANIMATION_FPS 30
+#if CONFIG_RGB7SEG_DITHER && !defined(CONFIG_RGB7SEG_DITHER_HZ)
+#define CONFIG_RGB7SEG_DITHER_HZ 200
+#endif
+#define CONFIG_RGB7SEG_FRAME_BUDGET_US 1000
+#ifndef CONFIG_RGB7SEG_SYMBOL_CACHE_KB
+#define CONFIG_RGB7SEG_SYMBOL_CACHE_KB 24
+#endif
+#if !CONFIG_RGB7SEG_OUTPUT_CONSOLE
+#define CONFIG_RGB7SEG_OUTPUT_RMT 1
+#endif
+#define CONFIG_TEMP_BUS_GPIO 17
+#define CONFIG_TEMP_ONEWIRE_BITBANG 1
@@ -0,0 +1,3 @@
+#pragma once
+
+#define SOC_RMT_SUPPORT_TX_SYNCHRO 1
@@ -0,0 +1,30 @@
+// Checks of the host tests. A failed check is printed and counted, the
+// test program returns nonzero if anything failed.
+#pragma once
+#include <stdio.h>
+
+static int test_failures;
+
+#define CHECK(cond) do {                                                \
+        if (!(cond)) {                                                  \
+            test_failures++;                                            \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        }                                                               \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) do {                                 \
+        long long actual_ = (actual), expected_ = (expected);           \
+        if (actual_ != expected_) {                                     \
+            test_failures++;                                            \
+            fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n",       \
+                __FILE__, __LINE__, #actual, actual_, expected_);       \
+        }                                                               \
+    } while (0)
+
+#define RUN(test) do {                                                  \
+        int before_ = test_failures;                                    \
+        test();                                                         \
+        printf("%s %s\n", test_failures == before_ ? "ok  " : "FAIL", #test); \
+    } while (0)
+
+#define TEST_RESULT() (test_failures ? 1 : 0)
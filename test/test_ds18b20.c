@@ -0,0 +1,541 @@
+// Host tests of the 1-Wire code on the simulated bus of onewire_sim.c,
+// with the slots some operations cost on the wire
+#include <inttypes.h>
+#include "sdkconfig.h"
+#include "ds18b20.c"
+#include "onewire_sim.h"
+#include "host_idf.h"
+#include "test.h"
+
+
+static struct ow_sim sim;
+static ds18b20_bus_t bus;
+static struct ds18b20_slots before;
+
+// serial numbers which branch at different rom bits
+static const uint64_t serials[] = { 0x000001, 0x000002, 0x000003, 0x010001, 0x800000000000, 0x7ff000, 0x000101, 0x123456 };
+#define SERIALS (sizeof(serials) / sizeof(serials[0]))
+
+
+// a fresh bus, as after a boot, on the devices of the simulator
+static void boot(void)
+{
+    if (bus.conv_timer != NULL)
+    {
+        esp_timer_delete(bus.conv_timer);
+        vQueueDelete(bus.conv_done);
+    }
+    memset(&bus, 0, sizeof(bus));
+    bus_count = 0;
+    zone_set = false;
+    ds18b20_bus_set_ops(&bus, &ow_sim_ops, &sim);
+    ds18b20_bus_init(&bus, CONFIG_TEMP_BUS_GPIO);
+    host_advance_us(1000000);
+}
+
+static void setup(int devices, float temperature)
+{
+    ow_sim_init(&sim);
+    for (int i = 0; i < devices; i++)
+    {
+        ow_sim_add(&sim, serials[i], temperature);
+    }
+    ds18b20_useRoster(0);
+    host_flash_clear();
+    boot();
+}
+
+static void slots_start(void)
+{
+    before = bus.slots;
+}
+
+static void check_slots(int line, uint32_t resets, uint32_t writes, uint32_t reads)
+{
+    if (bus.slots.resets - before.resets != resets || bus.slots.writes - before.writes != writes ||
+        bus.slots.reads - before.reads != reads)
+    {
+        test_failures++;
+        fprintf(stderr, "%s:%d: slots %" PRIu32 " resets %" PRIu32 " writes %" PRIu32 " reads, expected %" PRIu32 " %" PRIu32 " %" PRIu32 "\n", __FILE__, line,
+            bus.slots.resets - before.resets, bus.slots.writes - before.writes, bus.slots.reads - before.reads,
+            resets, writes, reads);
+    }
+}
+#define CHECK_SLOTS(resets, writes, reads) check_slots(__LINE__, resets, writes, reads)
+
+// time slots since slots_start(), a reset takes about 14
+static uint32_t slots_used(void)
+{
+    return (bus.slots.resets - before.resets) * 14 + bus.slots.writes - before.writes + bus.slots.reads - before.reads;
+}
+
+static int search_all(uint8_t found[][8], bool normal)
+{
+    uint8_t addr[8];
+    int n = 0;
+
+    ds18b20_bus_reset_search(&bus);
+    while (n < OW_SIM_DEVICES && ds18b20_bus_search(&bus, addr, normal))
+    {
+        memcpy(found[n++], addr, 8);
+    }
+    return n;
+}
+
+// how many times the device is among the found addresses
+static int times_found(const struct ow_sim_device *d, uint8_t found[][8], int n)
+{
+    int times = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        times += !memcmp(found[i], d->rom, 8);
+    }
+    return times;
+}
+
+
+static void test_crc8(void)
+{
+    // Maxim application note 27, rom 02 1C B8 01 00 00 00 A2
+    static const uint8_t rom[8] = { 0x02, 0x1c, 0xb8, 0x01, 0x00, 0x00, 0x00, 0xa2 };
+    // DS18B20 scratchpad at power up
+    static const uint8_t power_up[9] = { 0x50, 0x05, 0x4b, 0x46, 0x7f, 0xff, 0x0c, 0x10, 0x1c };
+    uint8_t data[32];
+
+    CHECK_EQ(ds18b20_crc8(rom, 7), 0xa2);
+    CHECK_EQ(ds18b20_crc8(rom, 8), 0);
+    CHECK_EQ(ds18b20_crc8(power_up, 8), 0x1c);
+    CHECK_EQ(ds18b20_crc8(power_up, 9), 0);
+    CHECK_EQ(ds18b20_crc8(rom, 0), 0);
+    // the nibble tables against the crc a bit at a time
+    srand(1);
+    for (int i = 0; i < 1000; i++)
+    {
+        int len = rand() % sizeof(data);
+        for (int j = 0; j < len; j++)
+        {
+            data[j] = rand();
+        }
+        CHECK_EQ(ds18b20_crc8(data, len), ow_sim_crc8(data, len));
+    }
+}
+
+static void test_search(void)
+{
+    uint8_t found[OW_SIM_DEVICES][8];
+    int n;
+
+    setup(SERIALS, 20.0f);
+    n = search_all(found, true);
+    CHECK_EQ(n, SERIALS);
+    for (int i = 0; i < sim.count; i++)
+    {
+        CHECK_EQ(times_found(&sim.devices[i], found, n), 1);
+    }
+    for (int i = 0; i < n; i++)
+    {
+        CHECK_EQ(ds18b20_crc8(found[i], 8), 0);
+    }
+    // again from the start
+    CHECK_EQ(search_all(found, true), SERIALS);
+
+    // unplugged sensors drop out
+    sim.devices[0].present = false;
+    sim.devices[4].present = false;
+    n = search_all(found, true);
+    CHECK_EQ(n, SERIALS - 2);
+    CHECK_EQ(times_found(&sim.devices[0], found, n), 0);
+    CHECK_EQ(times_found(&sim.devices[4], found, n), 0);
+    CHECK_EQ(times_found(&sim.devices[5], found, n), 1);
+
+    setup(0, 20.0f);
+    CHECK_EQ(search_all(found, true), 0);
+}
+
+// only the sensors outside their TH..TL answer the alarm search
+static void test_alarm_search(void)
+{
+    uint8_t found[OW_SIM_DEVICES][8];
+    ScratchPad scratchPad;
+    int n;
+
+    setup(5, 20.0f);
+    for (int i = 0; i < sim.count; i++)
+    {
+        const DeviceAddress *addr = (const DeviceAddress *) sim.devices[i].rom;
+        CHECK(ds18b20_bus_isConnected(&bus, addr, scratchPad));
+        scratchPad[HIGH_ALARM_TEMP] = 30;
+        scratchPad[LOW_ALARM_TEMP] = 10;
+        ds18b20_bus_writeScratchPad(&bus, addr, scratchPad);
+    }
+    sim.devices[1].temperature = 30.0f;
+    sim.devices[3].temperature = 10.5f;
+    ds18b20_bus_requestTemperatures(&bus);
+    n = search_all(found, false);
+    CHECK_EQ(n, 2);
+    CHECK_EQ(times_found(&sim.devices[1], found, n), 1);
+    CHECK_EQ(times_found(&sim.devices[3], found, n), 1);
+
+    sim.devices[1].temperature = 29.9f;
+    ds18b20_bus_requestTemperatures(&bus);
+    n = search_all(found, false);
+    CHECK_EQ(n, 1);
+    CHECK_EQ(times_found(&sim.devices[3], found, n), 1);
+}
+
+static void test_is_connected(void)
+{
+    static const uint8_t missing[8] = { 0x28, 0x99, 0x99, 0x99, 0x00, 0x00, 0x00, 0x00 };
+    DeviceAddress addr;
+    ScratchPad scratchPad;
+
+    setup(2, 21.5f);
+    ds18b20_bus_requestTemperatures(&bus);
+    memcpy(addr, sim.devices[1].rom, 8);
+    CHECK(ds18b20_bus_isConnected(&bus, (const DeviceAddress *) addr, scratchPad));
+    CHECK(!memcmp(scratchPad, sim.devices[1].scratchpad, sizeof(scratchPad)));
+    CHECK(ds18b20_bus_getTempC(&bus, (const DeviceAddress *) addr) == 21.5f);
+
+    // nobody answers an address which is not on the bus
+    memcpy(addr, missing, 8);
+    addr[7] = ds18b20_crc8(addr, 7);
+    CHECK(!ds18b20_bus_isConnected(&bus, (const DeviceAddress *) addr, scratchPad));
+    CHECK_EQ(ds18b20_bus_getTempC(&bus, (const DeviceAddress *) addr), DEVICE_DISCONNECTED_C);
+
+    // unplugged from a bus with other sensors, and from an empty bus
+    memcpy(addr, sim.devices[0].rom, 8);
+    sim.devices[0].present = false;
+    CHECK(!ds18b20_bus_isConnected(&bus, (const DeviceAddress *) addr, scratchPad));
+    sim.devices[1].present = false;
+    slots_start();
+    CHECK(!ds18b20_bus_isConnected(&bus, (const DeviceAddress *) addr, scratchPad));
+    // without a presence pulse the read gives up after the reset
+    CHECK_SLOTS(1, 0, 0);
+}
+
+// a scratchpad with a bad crc is read, but the sensor counts as disconnected
+static void test_bad_scratchpad_crc(void)
+{
+    const DeviceAddress *addr;
+    ScratchPad scratchPad;
+
+    setup(2, 20.0f);
+    ds18b20_bus_requestTemperatures(&bus);
+    addr = (const DeviceAddress *) sim.devices[1].rom;
+    sim.devices[1].corrupt_crc = OW_SIM_BAD_SCRATCHPAD_CRC;
+    CHECK(ds18b20_bus_readScratchPad(&bus, addr, scratchPad));
+    CHECK(ds18b20_crc8(scratchPad, 8) != scratchPad[SCRATCHPAD_CRC]);
+    CHECK(!ds18b20_bus_isConnected(&bus, addr, scratchPad));
+    CHECK_EQ(ds18b20_bus_getTempC(&bus, addr), DEVICE_DISCONNECTED_C);
+    CHECK(ds18b20_bus_getTempC(&bus, (const DeviceAddress *) sim.devices[0].rom) == 20.0f);
+
+    sim.devices[1].corrupt_crc = 0;
+    CHECK(ds18b20_bus_isConnected(&bus, addr, scratchPad));
+}
+
+// a rom with a bad crc is neither returned by the search nor put in the roster
+static void test_bad_rom_crc(void)
+{
+    uint8_t found[OW_SIM_DEVICES][8];
+    int n;
+
+    setup(SERIALS, 20.0f);
+    sim.devices[2].corrupt_crc = OW_SIM_BAD_ROM_CRC;
+    sim.devices[SERIALS - 1].corrupt_crc = OW_SIM_BAD_ROM_CRC;
+    n = search_all(found, true);
+    CHECK_EQ(n, SERIALS - 2);
+    for (int i = 0; i < sim.count; i++)
+    {
+        CHECK_EQ(times_found(&sim.devices[i], found, n), !sim.devices[i].corrupt_crc);
+    }
+
+    ds18b20_useRoster(1);
+    boot();
+    ds18b20_bus_requestTemperatures(&bus);
+    CHECK_EQ(bus.roster.count, SERIALS - 2);
+    for (int i = 0; i < bus.roster.count; i++)
+    {
+        CHECK_EQ(ds18b20_crc8(bus.roster.addr[i], 8), 0);
+    }
+    ds18b20_useRoster(0);
+}
+
+// The conversion is waited for by its nominal time, a slow sensor still
+// has the old reading then. The bus tells when all sensors are done.
+static void test_conversion_delay(void)
+{
+    const DeviceAddress *addr;
+    struct ow_sim_device *d;
+
+    setup(1, 20.0f);
+    d = &sim.devices[0];
+    addr = (const DeviceAddress *) d->rom;
+    d->conv_us = 800000;
+    ds18b20_bus_requestTemperatures(&bus);
+    CHECK(ds18b20_bus_getTempC(&bus, addr) == 85.0f);
+    host_advance_us(50000);
+    CHECK(ds18b20_bus_getTempC(&bus, addr) == 20.0f);
+
+    d->conv_us = 100000;
+    d->temperature = 21.0f;
+    CHECK(ds18b20_bus_startConversion(&bus, NULL, 0));
+    CHECK(!ds18b20_bus_isConversionComplete(&bus));
+    host_advance_us(100000);
+    CHECK(ds18b20_bus_isConversionComplete(&bus));
+    CHECK(ds18b20_bus_conversionPending(&bus));
+    CHECK(ds18b20_bus_getTempC(&bus, addr) == 21.0f);
+}
+
+static void test_slots(void)
+{
+    uint8_t found[OW_SIM_DEVICES][8];
+    ScratchPad scratchPad;
+
+    setup(3, 20.0f);
+    // the first conversion also searches the bus for the roster
+    slots_start();
+    ds18b20_bus_requestTemperatures(&bus);
+    CHECK_SLOTS(1 + 3, 16 + 3 * 72, 3 * 128);
+    // skip rom and convert
+    slots_start();
+    ds18b20_bus_requestTemperatures(&bus);
+    CHECK_SLOTS(1, 16, 0);
+    // match rom, read scratchpad and 9 bytes
+    slots_start();
+    ds18b20_bus_isConnected(&bus, (const DeviceAddress *) sim.devices[0].rom, scratchPad);
+    CHECK_SLOTS(2, 80, 72);
+    // each sensor found costs a search command, 64 written bits and 128 read
+    slots_start();
+    CHECK_EQ(search_all(found, true), 3);
+    CHECK_SLOTS(3, 3 * 72, 3 * 128);
+}
+
+// Slots of a polling cycle of 8 sensors which read everything, and of one
+// which reads only the sensors that moved out of their alarm window
+static void test_sample_slots(void)
+{
+    DeviceAddress sensors[SERIALS];
+    float temps[SERIALS];
+    uint32_t full, sampled;
+
+    setup(SERIALS, 20.0f);
+    for (int i = 0; i < SERIALS; i++)
+    {
+        memcpy(sensors[i], sim.devices[i].rom, 8);
+    }
+    ds18b20_bus_requestTemperatures(&bus);
+
+    slots_start();
+    ds18b20_bus_requestTemperatures(&bus);
+    for (int i = 0; i < SERIALS; i++)
+    {
+        CHECK(ds18b20_bus_getTempC(&bus, (const DeviceAddress *) sensors[i]) == 20.0f);
+    }
+    CHECK_SLOTS(1 + SERIALS * 2, 16 + SERIALS * 80, SERIALS * 72);
+    full = slots_used();
+
+    // the first cycle reads all and sets the alarm windows
+    CHECK_EQ(ds18b20_bus_sampleChanged(&bus, (const DeviceAddress *) sensors, SERIALS, temps, 1), SERIALS);
+    slots_start();
+    CHECK_EQ(ds18b20_bus_sampleChanged(&bus, (const DeviceAddress *) sensors, SERIALS, temps, 1), 0);
+    // conversion, and an alarm search which nobody answers
+    CHECK_SLOTS(2, 16 + 8, 2);
+    sampled = slots_used();
+    CHECK(temps[0] == 20.0f);
+
+    sim.devices[2].temperature = 22.0f;
+    slots_start();
+    CHECK_EQ(ds18b20_bus_sampleChanged(&bus, (const DeviceAddress *) sensors, SERIALS, temps, 1), 1);
+    CHECK(temps[2] == 22.0f);
+    // one sensor found by the alarm search, read, and its window moved
+    CHECK_SLOTS(1 + 1 + 2 + 2, 16 + 72 + 80 + 104, 128 + 72);
+
+    printf("slots per cycle of %d sensors: %" PRIu32 " all read, %" PRIu32 " none moved, %" PRIu32 " one moved\n", (int) SERIALS,
+        full, sampled, slots_used());
+    CHECK(sampled * 10 < full);
+}
+
+// A valid roster replaces the search at boot, and the bus is searched again
+// only ROSTER_SCAN_US later
+static void test_roster(void)
+{
+    uint8_t found[OW_SIM_DEVICES][8];
+
+    setup(3, 20.0f);
+    ds18b20_useRoster(1);
+    CHECK_EQ(search_all(found, true), 3);
+    ds18b20_bus_requestTemperatures(&bus);
+    CHECK_EQ(host_flash_commits, 1);
+    CHECK(!ds18b20_bus_rosterChanged(&bus));
+
+    boot();
+    slots_start();
+    CHECK_EQ(search_all(found, true), 3);
+    // the stored addresses are read, the rom tree is not walked
+    CHECK_SLOTS(3 * 2, 3 * 80, 3 * 72);
+    for (int i = 0; i < sim.count; i++)
+    {
+        CHECK_EQ(times_found(&sim.devices[i], found, 3), 1);
+    }
+    slots_start();
+    ds18b20_bus_requestTemperatures(&bus);
+    CHECK_SLOTS(1, 16, 0);
+
+    // one scan without a sensor is not a change
+    sim.devices[1].present = false;
+    host_advance_us(ROSTER_SCAN_US);
+    ds18b20_bus_requestTemperatures(&bus);
+    CHECK(bus.roster_pending);
+    sim.devices[1].present = true;
+    host_advance_us(ROSTER_SCAN_US);
+    ds18b20_bus_requestTemperatures(&bus);
+    CHECK(!bus.roster_pending);
+    CHECK(!ds18b20_bus_rosterChanged(&bus));
+    CHECK_EQ(host_flash_commits, 1);
+    CHECK_EQ(bus.roster.count, 3);
+
+    // a new sensor is taken when the next scan finds it again
+    ow_sim_add(&sim, serials[3], 20.0f);
+    host_advance_us(ROSTER_SCAN_US);
+    ds18b20_bus_requestTemperatures(&bus);
+    CHECK(!ds18b20_bus_rosterChanged(&bus));
+    CHECK_EQ(host_flash_commits, 1);
+    host_advance_us(ROSTER_SCAN_US);
+    ds18b20_bus_requestTemperatures(&bus);
+    CHECK(ds18b20_bus_rosterChanged(&bus));
+    CHECK_EQ(host_flash_commits, 2);
+    CHECK_EQ(bus.roster.count, 4);
+    // and is searched for, once the roster was replaced by a search
+    CHECK_EQ(search_all(found, true), 4);
+
+    // a roster which does not answer at all falls back to the search
+    boot();
+    for (int i = 0; i < sim.count; i++)
+    {
+        sim.devices[i].present = false;
+    }
+    ow_sim_add(&sim, serials[6], 20.0f);
+    CHECK_EQ(search_all(found, true), 1);
+    CHECK_EQ(times_found(&sim.devices[sim.count - 1], found, 1), 1);
+    ds18b20_useRoster(0);
+}
+
+// A sensor which powers up at another resolution than the cached one is
+// written back to the resolution the policy wants
+static void test_resolution_rewrite(void)
+{
+    const DeviceAddress *addr;
+    struct ow_sim_device *d;
+
+    setup(1, 20.0f);
+    d = &sim.devices[0];
+    addr = (const DeviceAddress *) d->rom;
+    d->eeprom[2] = TEMP_9_BIT;
+    ow_sim_power_up(d);
+    ds18b20_bus_requestTemperatures(&bus);
+    CHECK(ds18b20_bus_getTempC(&bus, addr) == 20.0f);
+    CHECK_EQ(d->scratchpad[CONFIGURATION], TEMP_12_BIT);
+    CHECK_EQ(sim.scratchpad_writes, 1);
+    ds18b20_bus_requestTemperatures(&bus);
+    CHECK(ds18b20_bus_getTempC(&bus, addr) == 20.0f);
+    CHECK_EQ(sim.scratchpad_writes, 1);
+
+    // stable and far from any zone, down to 9 bits
+    for (int i = 0; i < RES_STABLE_READINGS + 1; i++)
+    {
+        host_advance_us(10000000);
+        ds18b20_bus_requestTemperatures(&bus);
+        CHECK(ds18b20_bus_getTempC(&bus, addr) == 20.0f);
+    }
+    CHECK_EQ(ds18b20_bus_getSensorResolution(&bus, addr), 9);
+    CHECK_EQ(d->scratchpad[CONFIGURATION], TEMP_9_BIT);
+    CHECK_EQ(ds18b20_bus_millisToWaitForConversion(&bus), 94);
+}
+
+// The same resolution asked for every cycle, as with the single bus api,
+// does not hold the policy at it
+static void test_set_resolution(void)
+{
+    DeviceAddress sensors[1];
+    struct ow_sim_device *d;
+
+    setup(1, 20.0f);
+    d = &sim.devices[0];
+    memcpy(sensors[0], d->rom, 8);
+    for (int i = 0; i < RES_STABLE_READINGS + 2; i++)
+    {
+        CHECK(ds18b20_bus_setResolution(&bus, (const DeviceAddress *) sensors, 1, 12));
+        host_advance_us(10000000);
+        ds18b20_bus_requestTemperatures(&bus);
+        CHECK(ds18b20_bus_getTempC(&bus, (const DeviceAddress *) sensors[0]) == 20.0f);
+    }
+    CHECK_EQ(ds18b20_bus_getSensorResolution(&bus, (const DeviceAddress *) sensors[0]), 9);
+    CHECK_EQ(d->scratchpad[CONFIGURATION], TEMP_9_BIT);
+    CHECK_EQ(sim.scratchpad_writes, 1);
+
+    // another resolution starts the policy from it
+    CHECK(ds18b20_bus_setResolution(&bus, (const DeviceAddress *) sensors, 1, 11));
+    CHECK_EQ(ds18b20_bus_getSensorResolution(&bus, (const DeviceAddress *) sensors[0]), 11);
+    CHECK_EQ(d->scratchpad[CONFIGURATION], TEMP_11_BIT);
+    CHECK_EQ(ds18b20_bus_millisToWaitForConversion(&bus), 375);
+}
+
+// The window is deadband whole degrees either way of the rounded reading,
+// written with the resolution in one scratchpad write
+static void test_alarm_window(void)
+{
+    DeviceAddress sensors[1];
+    float temps[1];
+    struct ow_sim_device *d;
+
+    setup(1, 20.9f);
+    d = &sim.devices[0];
+    memcpy(sensors[0], d->rom, 8);
+    d->eeprom[2] = TEMP_9_BIT;
+    ow_sim_power_up(d);
+    ds18b20_bus_requestTemperatures(&bus);
+    sim.scratchpad_writes = 0;
+    CHECK_EQ(ds18b20_bus_sampleChanged(&bus, (const DeviceAddress *) sensors, 1, temps, 1), 1);
+    CHECK_EQ(sim.scratchpad_writes, 1);
+    CHECK_EQ(d->scratchpad[CONFIGURATION], TEMP_12_BIT);
+    // 20.5 at 9 bits rounds to 21
+    CHECK(temps[0] == 20.5f);
+    CHECK_EQ((int8_t) d->scratchpad[HIGH_ALARM_TEMP], 22);
+    CHECK_EQ((int8_t) d->scratchpad[LOW_ALARM_TEMP], 19);
+
+    // inside [20, 22) nothing is read
+    CHECK_EQ(ds18b20_bus_sampleChanged(&bus, (const DeviceAddress *) sensors, 1, temps, 1), 0);
+    d->temperature = 21.9375f;
+    CHECK_EQ(ds18b20_bus_sampleChanged(&bus, (const DeviceAddress *) sensors, 1, temps, 1), 0);
+    d->temperature = 20.0f;
+    CHECK_EQ(ds18b20_bus_sampleChanged(&bus, (const DeviceAddress *) sensors, 1, temps, 1), 0);
+    CHECK(temps[0] == 20.5f);
+    CHECK_EQ(sim.scratchpad_writes, 1);
+    d->temperature = 19.9375f;
+    CHECK_EQ(ds18b20_bus_sampleChanged(&bus, (const DeviceAddress *) sensors, 1, temps, 1), 1);
+    CHECK(temps[0] == 19.9375f);
+    CHECK_EQ((int8_t) d->scratchpad[HIGH_ALARM_TEMP], 21);
+    CHECK_EQ((int8_t) d->scratchpad[LOW_ALARM_TEMP], 18);
+    d->temperature = 21.0f;
+    CHECK_EQ(ds18b20_bus_sampleChanged(&bus, (const DeviceAddress *) sensors, 1, temps, 1), 1);
+}
+
+
+int main(void)
+{
+    RUN(test_crc8);
+    RUN(test_search);
+    RUN(test_alarm_search);
+    RUN(test_is_connected);
+    RUN(test_bad_scratchpad_crc);
+    RUN(test_bad_rom_crc);
+    RUN(test_conversion_delay);
+    RUN(test_slots);
+    RUN(test_sample_slots);
+    RUN(test_roster);
+    RUN(test_resolution_rewrite);
+    RUN(test_set_resolution);
+    RUN(test_alarm_window);
+    return TEST_RESULT();
+}
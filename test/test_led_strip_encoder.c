@@ -0,0 +1,226 @@
+// Host tests of the led strip encoders and the symbol decoder
+#include <stdlib.h>
+#include <string.h>
+#include "led_strip_encoder.h"
+#include "driver/rmt_tx.h"
+#include "host_idf.h"
+#include "test.h"
+
+
+#define RESOLUTION_HZ   10000000
+#define TICK_NS         (1000000000 / RESOLUTION_HZ)
+#define DATA_SIZE       30
+
+static const led_strip_encoder_config_t config = { .resolution = RESOLUTION_HZ };
+static const rmt_symbol_word_t reset_code = { .duration0 = 250, .duration1 = 250 };
+static uint8_t data[DATA_SIZE];
+static uint8_t decoded[DATA_SIZE];
+static rmt_symbol_word_t symbols[LED_STRIP_SYMBOLS(DATA_SIZE)];
+static rmt_symbol_word_t sent[LED_STRIP_SYMBOLS(DATA_SIZE)];
+static size_t sent_len;
+
+static int decode(const rmt_symbol_word_t *s, size_t n)
+{
+    return led_strip_decode_symbols(&config, s, n, decoded, sizeof(decoded));
+}
+
+static void setup(void)
+{
+    for (int i = 0; i < DATA_SIZE; i++)
+    {
+        data[i] = i * 37 + 11;
+    }
+    memset(decoded, 0, sizeof(decoded));
+    CHECK_EQ(led_strip_encode_symbols(&config, data, DATA_SIZE, symbols), LED_STRIP_SYMBOLS(DATA_SIZE));
+}
+
+static bool within(int ticks, int ns)
+{
+    return abs(ticks * TICK_NS - ns) <= 150;
+}
+
+
+static void test_round_trip(void)
+{
+    setup();
+    CHECK_EQ(decode(symbols, LED_STRIP_SYMBOLS(DATA_SIZE)), DATA_SIZE);
+    CHECK(!memcmp(decoded, data, DATA_SIZE));
+}
+
+// Each high and low time may be 150ns off the datasheet. Every timing up
+// to 2us is sent as a whole byte of the same bit.
+static void test_bit_tolerance(void)
+{
+    rmt_symbol_word_t byte[9];
+    int ones = 0, zeros = 0;
+
+    for (int high = 1; high < 20; high++)
+    {
+        for (int low = 1; low < 20; low++)
+        {
+            bool one = within(high, 800) && within(low, 450);
+            bool zero = within(high, 400) && within(low, 850);
+
+            for (int i = 0; i < 8; i++)
+            {
+                byte[i] = (rmt_symbol_word_t) { .level0 = 1, .duration0 = high, .level1 = 0, .duration1 = low };
+            }
+            byte[8] = reset_code;
+            decoded[0] = 0x55;
+            if (one || zero)
+            {
+                CHECK_EQ(decode(byte, 9), 1);
+                CHECK_EQ(decoded[0], one ? 0xff : 0x00);
+            }
+            else
+            {
+                CHECK_EQ(decode(byte, 9), -1);
+            }
+            ones += one;
+            zeros += zero;
+        }
+    }
+    // at 100ns ticks, 3 high times and 4 low times fit each bit
+    CHECK_EQ(ones, 12);
+    CHECK_EQ(zeros, 12);
+}
+
+// T1H of 1000ns is only 100ns off the encoder's 900ns, but 200ns off
+// the datasheet
+static void test_wrong_timing(void)
+{
+    setup();
+    for (size_t i = 0; i < LED_STRIP_SYMBOLS(DATA_SIZE) - 1; i++)
+    {
+        if (symbols[i].duration0 > symbols[i].duration1)
+            symbols[i].duration0 = 1000 / TICK_NS;
+    }
+    CHECK_EQ(decode(symbols, LED_STRIP_SYMBOLS(DATA_SIZE)), -1);
+}
+
+static void test_reset_code(void)
+{
+    setup();
+    symbols[DATA_SIZE * 8].duration1 = 240;
+    CHECK_EQ(decode(symbols, LED_STRIP_SYMBOLS(DATA_SIZE)), -1);
+    setup();
+    CHECK_EQ(decode(symbols, LED_STRIP_SYMBOLS(DATA_SIZE) - 1), -1);
+    // reset code in the middle of a byte
+    setup();
+    symbols[12] = reset_code;
+    CHECK_EQ(decode(symbols, LED_STRIP_SYMBOLS(DATA_SIZE)), -1);
+    // reset code after a whole byte ends the frame there
+    setup();
+    symbols[16] = reset_code;
+    CHECK_EQ(decode(symbols, LED_STRIP_SYMBOLS(DATA_SIZE)), 2);
+}
+
+static void test_data_size(void)
+{
+    setup();
+    CHECK_EQ(led_strip_decode_symbols(&config, symbols, LED_STRIP_SYMBOLS(DATA_SIZE), decoded, DATA_SIZE - 1), -1);
+}
+
+
+static void record_sent(int gpio, const rmt_symbol_word_t *s, size_t n)
+{
+    sent_len = n;
+    if (n <= LED_STRIP_SYMBOLS(DATA_SIZE))
+        memcpy(sent, s, n * sizeof(rmt_symbol_word_t));
+}
+
+// The rmt encoder sends the same symbols, also when it has to stop at a
+// full channel memory block and go on later
+static void test_rmt_encoder(void)
+{
+    rmt_tx_channel_config_t chan_config = {
+        .gpio_num = 0,
+        .mem_block_symbols = 64,
+        .resolution_hz = RESOLUTION_HZ,
+    };
+    rmt_transmit_config_t tx_config = {};
+    rmt_copy_encoder_config_t copy_config = {};
+    rmt_channel_handle_t chan;
+    rmt_encoder_handle_t encoder, copy_encoder;
+
+    setup();
+    host_rmt_sent = record_sent;
+    CHECK_EQ(rmt_new_tx_channel(&chan_config, &chan), ESP_OK);
+    CHECK_EQ(rmt_new_led_strip_encoder(&config, &encoder), ESP_OK);
+    CHECK_EQ(rmt_new_copy_encoder(&copy_config, &copy_encoder), ESP_OK);
+    CHECK_EQ(rmt_enable(chan), ESP_OK);
+
+    for (int size = 1; size <= DATA_SIZE; size++)
+    {
+        CHECK_EQ(rmt_transmit(chan, encoder, data, size, &tx_config), ESP_OK);
+        CHECK_EQ(sent_len, LED_STRIP_SYMBOLS(size));
+        CHECK(!memcmp(sent, symbols, size * 8 * sizeof(rmt_symbol_word_t)));
+        CHECK_EQ(sent[size * 8].val, symbols[DATA_SIZE * 8].val);
+        CHECK_EQ(decode(sent, sent_len), size);
+    }
+
+    // symbols encoded in memory go out unchanged with the copy encoder
+    CHECK_EQ(rmt_transmit(chan, copy_encoder, symbols, sizeof(symbols), &tx_config), ESP_OK);
+    CHECK_EQ(sent_len, LED_STRIP_SYMBOLS(DATA_SIZE));
+    CHECK(!memcmp(sent, symbols, sizeof(symbols)));
+
+    rmt_del_encoder(encoder);
+    rmt_del_encoder(copy_encoder);
+    rmt_disable(chan);
+    rmt_del_channel(chan);
+    host_rmt_sent = NULL;
+}
+
+// Palette frames hold two 4 bit leds in a byte, the first in the low nibble
+static void test_palette_encoder(void)
+{
+    uint8_t palette[16 * 3];
+    uint8_t indexes[5] = { 0x10, 0x32, 0x54, 0xf6, 0x0e };
+    uint8_t expected[10 * 3];
+    rmt_tx_channel_config_t chan_config = {
+        .gpio_num = 0,
+        .mem_block_symbols = 48,
+        .resolution_hz = RESOLUTION_HZ,
+    };
+    led_strip_palette_encoder_config_t palette_config = {
+        .resolution = RESOLUTION_HZ,
+        .palette = palette,
+    };
+    rmt_transmit_config_t tx_config = {};
+    rmt_channel_handle_t chan;
+    rmt_encoder_handle_t encoder;
+
+    for (int i = 0; i < sizeof(palette); i++)
+    {
+        palette[i] = i * 5 + 1;
+    }
+    for (int led = 0; led < 10; led++)
+    {
+        int index = (led & 1) ? indexes[led / 2] >> 4 : indexes[led / 2] & 0x0f;
+        memcpy(&expected[led * 3], &palette[index * 3], 3);
+    }
+    host_rmt_sent = record_sent;
+    CHECK_EQ(rmt_new_tx_channel(&chan_config, &chan), ESP_OK);
+    CHECK_EQ(rmt_new_led_palette_encoder(&palette_config, &encoder), ESP_OK);
+    CHECK_EQ(rmt_enable(chan), ESP_OK);
+    CHECK_EQ(rmt_transmit(chan, encoder, indexes, sizeof(indexes), &tx_config), ESP_OK);
+    CHECK_EQ(decode(sent, sent_len), sizeof(expected));
+    CHECK(!memcmp(decoded, expected, sizeof(expected)));
+    rmt_del_encoder(encoder);
+    rmt_disable(chan);
+    rmt_del_channel(chan);
+    host_rmt_sent = NULL;
+}
+
+
+int main(void)
+{
+    RUN(test_round_trip);
+    RUN(test_bit_tolerance);
+    RUN(test_wrong_timing);
+    RUN(test_reset_code);
+    RUN(test_data_size);
+    RUN(test_rmt_encoder);
+    RUN(test_palette_encoder);
+    return TEST_RESULT();
+}
@@ -0,0 +1,473 @@
+// Host tests of the display rendering, built for each strip color order
+#include "rgb7seg.c"
+#include "test.h"
+
+
+static uint8_t *frame;
+static uint32_t load[RGB7SEG_MAX_DIGITS + 1];
+static const struct color red = { 255, 0, 0 };
+static const struct color palette4[RGB7SEG_MAX_DIGITS] =
+{
+    { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 }, { 200, 100, 50 },
+};
+
+// At full brightness led values are the gamma corrected colors
+static void setup(int ndigits, int segleds, const char *order)
+{
+    struct rgb7seg_layout l = { .digits = ndigits, .segleds = segleds };
+
+    strncpy(l.order, order, sizeof(l.order) - 1);
+    init_layout(&l);
+    apply_brightness(255);
+    memset(indicators, 0, sizeof(indicators));
+    blink_off = false;
+    free(frame);
+    frame = malloc(frame_size);
+    assert(frame);
+}
+
+// first led of a segment, from the layout order instead of seg_map
+static int segment_led(int digit, int s)
+{
+    return digit * SEGMENTS * layout.segleds + (strchr(layout.order, 'a' + s) - layout.order) * layout.segleds;
+}
+
+static struct pixel led_at(const uint8_t *pixels, int led)
+{
+    return ((const struct pixel *) pixels)[led];
+}
+
+static bool led_lit(const uint8_t *pixels, int led)
+{
+    struct pixel p = led_at(pixels, led);
+
+    return p.wire[0] || p.wire[1] || p.wire[2];
+}
+
+static bool same_pixel(struct pixel a, struct pixel b)
+{
+    return !memcmp(a.wire, b.wire, sizeof(a.wire));
+}
+
+// segments lit in a digit of the frame, every led of a segment is checked
+static uint8_t lit_segments(const uint8_t *pixels, int digit)
+{
+    uint8_t mask = 0;
+
+    for (int s = 0; s < SEGMENTS; s++)
+    {
+        int lit = 0;
+
+        for (int k = 0; k < layout.segleds; k++)
+        {
+            lit += led_lit(pixels, segment_led(digit, s) + k);
+        }
+        CHECK(lit == 0 || lit == layout.segleds);
+        if (lit)
+            mask |= 1 << s;
+    }
+    return mask;
+}
+
+
+static void test_blit_masks(void)
+{
+    ledval c;
+
+    setup(4, 2, "abcdefg");
+    c = led_color(red);
+    for (int mask = 0; mask < 0x80; mask++)
+    {
+        memset(frame, 0, frame_size);
+        uint32_t l = blit_7seg(frame, 1, mask, c);
+
+        CHECK_EQ(lit_segments(frame, 1), mask);
+        CHECK_EQ(lit_segments(frame, 0), 0);
+        CHECK_EQ(lit_segments(frame, 2), 0);
+        CHECK_EQ(l, __builtin_popcount(mask) * layout.segleds * pixel_load(c));
+        CHECK_EQ(l, leds_load(frame, 0, strip_leds));
+    }
+}
+
+static void test_glyphs(void)
+{
+    setup(4, 2, "abcdefg");
+    set_7seg(frame, "0123", palette4, load);
+    CHECK_EQ(lit_segments(frame, 0), 0x3f);
+    CHECK_EQ(lit_segments(frame, 1), 0x06);
+    CHECK_EQ(lit_segments(frame, 2), 0x5b);
+    CHECK_EQ(lit_segments(frame, 3), 0x4f);
+    set_7seg(frame, "478-", palette4, load);
+    CHECK_EQ(lit_segments(frame, 0), 0x66);
+    CHECK_EQ(lit_segments(frame, 1), 0x07);
+    CHECK_EQ(lit_segments(frame, 2), 0x7f);
+    CHECK_EQ(lit_segments(frame, 3), 0x40);
+}
+
+static void test_digit_colors(void)
+{
+    setup(4, 2, "abcdefg");
+    set_7seg(frame, "8888", palette4, load);
+    for (int i = 0; i < 4; i++)
+    {
+        for (int s = 0; s < SEGMENTS; s++)
+        {
+            CHECK(same_pixel(led_at(frame, segment_led(i, s)), wire_color(palette4[i])));
+        }
+    }
+}
+
+static void test_indicators(void)
+{
+    uint32_t total;
+
+    setup(4, 2, "abcdefg");
+    total = set_7seg(frame, "12:34", palette4, load);
+    CHECK_EQ(lit_segments(frame, 0), 0x06);
+    CHECK_EQ(lit_segments(frame, 1), 0x5b);
+    CHECK_EQ(lit_segments(frame, 2), 0x4f);
+    CHECK_EQ(lit_segments(frame, 3), 0x66);
+    // colon has the color of the digit before it
+    CHECK(same_pixel(led_at(frame, indicator_led + RGB7SEG_COLON), wire_color(palette4[1])));
+    CHECK(!led_lit(frame, indicator_led + RGB7SEG_DP));
+    CHECK_EQ(total, leds_load(frame, 0, strip_leds));
+    CHECK_EQ(load[4], leds_load(frame, indicator_led, INDICATORS));
+
+    total = set_7seg(frame, "-1.5", palette4, load);
+    CHECK_EQ(lit_segments(frame, 0), 0x40);
+    CHECK_EQ(lit_segments(frame, 1), 0x06);
+    CHECK_EQ(lit_segments(frame, 2), 0x6d);
+    CHECK_EQ(lit_segments(frame, 3), 0);
+    CHECK(!led_lit(frame, indicator_led + RGB7SEG_COLON));
+    CHECK(same_pixel(led_at(frame, indicator_led + RGB7SEG_DP), wire_color(palette4[1])));
+    CHECK_EQ(total, leds_load(frame, 0, strip_leds));
+}
+
+// utf-8 like the degree sign takes digits, but they stay dark
+static void test_high_bytes(void)
+{
+    setup(4, 2, "abcdefg");
+    CHECK_EQ(glyph((char) 0x80), 0);
+    CHECK_EQ(glyph((char) 0xb0), 0);
+    CHECK_EQ(glyph((char) 0xff), 0);
+    set_7seg(frame, "5\xc2\xb0" "C", palette4, load);
+    CHECK_EQ(lit_segments(frame, 0), 0x6d);
+    CHECK_EQ(lit_segments(frame, 1), 0);
+    CHECK_EQ(lit_segments(frame, 2), 0);
+    CHECK_EQ(lit_segments(frame, 3), 0x39);
+    CHECK_EQ(rgb7seg_text_digits("5\xc2\xb0" "C"), 4);
+}
+
+static void test_text_digits(void)
+{
+    CHECK_EQ(rgb7seg_text_digits(""), 0);
+    CHECK_EQ(rgb7seg_text_digits("12:34"), 4);
+    CHECK_EQ(rgb7seg_text_digits("-1.5"), 3);
+    CHECK_EQ(rgb7seg_text_digits("hello world"), 11);
+}
+
+// text longer than the display is cut
+static void test_long_text(void)
+{
+    setup(4, 2, "abcdefg");
+    set_7seg(frame, "123456", palette4, load);
+    CHECK_EQ(lit_segments(frame, 3), 0x66);
+    CHECK(!led_lit(frame, indicator_led + RGB7SEG_COLON));
+    CHECK(!led_lit(frame, indicator_led + RGB7SEG_DP));
+}
+
+// a marquee of 8 digits on 4 has each digit color on two of its digits
+static void test_marquee_colors(void)
+{
+    struct panel p = { 0 };
+
+    setup(4, 2, "abcdefg");
+    p.marquee.strip = malloc(marquee_size);
+    assert(p.marquee.strip);
+    strcpy(p.marquee.text, "8888.8888");
+    memcpy(p.marquee.colors, palette4, sizeof(p.marquee.colors));
+    marquee_render(&p);
+    CHECK_EQ(p.marquee.len, 8 + 4);
+    for (int i = 0; i < 8; i++)
+    {
+        CHECK_EQ(lit_segments(p.marquee.strip, i), 0x7f);
+        CHECK(same_pixel(led_at(p.marquee.strip, segment_led(i, 0)), wire_color(palette4[i / 2])));
+    }
+    CHECK_EQ(lit_segments(p.marquee.strip, 8), 0);
+    free(p.marquee.strip);
+}
+
+static bool valid(int ndigits, int segleds, const char *order)
+{
+    struct rgb7seg_layout l = { .digits = ndigits, .segleds = segleds };
+
+    strncpy(l.order, order, sizeof(l.order) - 1);
+    return layout_valid(&l);
+}
+
+static void test_layout_valid(void)
+{
+    CHECK(valid(4, 2, "abcdefg"));
+    CHECK(valid(1, 1, "gfedcba"));
+    CHECK(valid(RGB7SEG_MAX_DIGITS, RGB7SEG_MAX_SEGLEDS, "fabgedc"));
+    CHECK(!valid(0, 2, "abcdefg"));
+    CHECK(!valid(RGB7SEG_MAX_DIGITS + 1, 2, "abcdefg"));
+    CHECK(!valid(4, 0, "abcdefg"));
+    CHECK(!valid(4, RGB7SEG_MAX_SEGLEDS + 1, "abcdefg"));
+    CHECK(!valid(4, 2, "abcdef"));
+    CHECK(!valid(4, 2, "aacdefg"));
+    CHECK(!valid(4, 2, "abcdefa"));
+    CHECK(!valid(4, 2, "abcdefh"));
+    CHECK(!valid(4, 2, "ABCDEFG"));
+    CHECK(!valid(4, 2, ""));
+}
+
+static void test_layout_fallback(void)
+{
+    setup(0, 9, "xyz");
+    CHECK_EQ(digits, CONFIG_RGB7SEG_DIGITS);
+    CHECK_EQ(layout.segleds, CONFIG_RGB7SEG_SEGMENT_LEDS);
+    CHECK(!strcmp(layout.order, CONFIG_RGB7SEG_SEGMENT_ORDER));
+    init_layout(NULL);
+    CHECK_EQ(digits, CONFIG_RGB7SEG_DIGITS);
+}
+
+// every segment of every digit lights its own leds and nothing else
+static void check_geometry(int ndigits, int segleds, const char *order)
+{
+    ledval c;
+
+    setup(ndigits, segleds, order);
+    c = led_color(red);
+    CHECK_EQ(digits, ndigits);
+    CHECK_EQ(strip_leds, ndigits * SEGMENTS * segleds + INDICATORS);
+    CHECK_EQ(indicator_led, ndigits * SEGMENTS * segleds);
+    CHECK_EQ(frame_size, strip_leds * sizeof(struct pixel));
+    for (int d = 0; d < ndigits; d++)
+    {
+        for (int s = 0; s < SEGMENTS; s++)
+        {
+            int first = segment_led(d, s);
+
+            memset(frame, 0, frame_size);
+            blit_7seg(frame, d, 1 << s, c);
+            for (int led = 0; led < strip_leds; led++)
+            {
+                CHECK_EQ(led_lit(frame, led), led >= first && led < first + segleds);
+            }
+        }
+    }
+}
+
+static void test_layout_geometry(void)
+{
+    check_geometry(4, 2, "abcdefg");
+    check_geometry(1, 1, "gfedcba");
+    check_geometry(6, 3, "fabgedc");
+    check_geometry(RGB7SEG_MAX_DIGITS, RGB7SEG_MAX_SEGLEDS, "bcdefga");
+}
+
+#if CONFIG_RGB7SEG_COLOR_ORDER_GRB
+static const char wire_order[] = "grb";
+#elif CONFIG_RGB7SEG_COLOR_ORDER_BRG
+static const char wire_order[] = "brg";
+#else
+static const char wire_order[] = "rgb";
+#endif
+
+static uint8_t channel(struct color c, char ch)
+{
+    return (ch == 'r') ? c.r : (ch == 'g') ? c.g : c.b;
+}
+
+// the bytes of a led leave in the strip's color order
+static void test_wire_order(void)
+{
+    const struct color c = { 60, 140, 220 };
+    uint8_t *decoded;
+    rmt_symbol_word_t *symbols;
+    struct pixel p;
+
+    setup(4, 2, "abcdefg");
+    p = wire_color(c);
+    CHECK(p.wire[0] != p.wire[1] && p.wire[1] != p.wire[2] && p.wire[0] != p.wire[2]);
+    for (int k = 0; k < 3; k++)
+    {
+        CHECK_EQ(p.wire[k], level_lut[channel(c, wire_order[k])]);
+    }
+
+    set_7seg(frame, "8", &c, load);
+    CHECK(same_pixel(led_at(frame, segment_led(0, 0)), p));
+    symbols = malloc(LED_STRIP_SYMBOLS(frame_size) * sizeof(rmt_symbol_word_t));
+    decoded = malloc(frame_size);
+    assert(symbols && decoded);
+    led_strip_encode_symbols(&encoder_config, frame, frame_size, symbols);
+    CHECK_EQ(led_strip_decode_symbols(&encoder_config, symbols, LED_STRIP_SYMBOLS(frame_size), decoded, frame_size), frame_size);
+    for (int k = 0; k < 3; k++)
+    {
+        CHECK_EQ(decoded[segment_led(0, 0) * sizeof(struct pixel) + k], level_lut[channel(c, wire_order[k])]);
+    }
+    free(symbols);
+    free(decoded);
+}
+
+// empty cache for the current layout
+static void symcache_setup(void)
+{
+    for (int i = 0; i < symcache_entries; i++)
+    {
+        free(symcache[i].pixels);
+        free(symcache[i].symbols);
+    }
+    free(symcache);
+    symcache = NULL;
+    symcache_entries = 0;
+    symcache_clock = 0;
+    symcache_round = 0;
+    memset(&stats, 0, sizeof(stats));
+    init_symcache();
+}
+
+// frame showing the text
+static uint8_t *text_frame(char *text)
+{
+    uint8_t *f = malloc(frame_size);
+
+    assert(f);
+    set_7seg(f, text, palette4, load);
+    return f;
+}
+
+// is the frame in the cache, without touching its lru stamp
+static bool cached(const uint8_t *pixels)
+{
+    for (int i = 0; i < symcache_entries; i++)
+    {
+        if (symcache[i].used && !memcmp(symcache[i].pixels, pixels, frame_size))
+            return true;
+    }
+    return false;
+}
+
+static void test_symcache_hit(void)
+{
+    uint8_t *f, *decoded;
+    struct symcache_entry *e;
+
+    setup(4, 2, "abcdefg");
+    symcache_setup();
+    CHECK_EQ(symcache_entries, CONFIG_RGB7SEG_SYMBOL_CACHE_KB * 1024 /
+        (frame_size + LED_STRIP_SYMBOLS(frame_size) * sizeof(rmt_symbol_word_t)));
+    CHECK(symcache_entries >= 2);
+    f = text_frame("12:34");
+    decoded = malloc(frame_size);
+    assert(decoded);
+    e = symcache_get(f);
+    CHECK(e != NULL);
+    CHECK_EQ(stats.cachemisses, 1);
+    CHECK(symcache_get(f) == e);
+    CHECK_EQ(stats.cachehits, 1);
+    CHECK_EQ(led_strip_decode_symbols(&encoder_config, e->symbols, LED_STRIP_SYMBOLS(frame_size), decoded, frame_size), frame_size);
+    CHECK(!memcmp(decoded, f, frame_size));
+    free(decoded);
+    free(f);
+}
+
+// a miss replaces the least recently used entry
+static void test_symcache_lru(void)
+{
+    uint8_t *f[RGB7SEG_MAX_DIGITS * 2];
+    char text[16];
+
+    setup(4, 2, "abcdefg");
+    symcache_setup();
+    assert(symcache_entries + 1 < sizeof(f) / sizeof(f[0]));
+    for (int i = 0; i <= symcache_entries; i++)
+    {
+        snprintf(text, sizeof(text), "%d%d%d%d", i, i, i, i);
+        f[i] = text_frame(text);
+    }
+    for (int i = 0; i < symcache_entries; i++)
+    {
+        CHECK(symcache_get(f[i]) != NULL);
+    }
+    CHECK_EQ(stats.cachemisses, symcache_entries);
+    // the first frame is used again, the second one is now the oldest
+    CHECK(symcache_get(f[0]) != NULL);
+    symcache_round = symcache_clock;
+    CHECK(symcache_get(f[symcache_entries]) != NULL);
+    CHECK(!cached(f[1]));
+    for (int i = 0; i <= symcache_entries; i++)
+    {
+        CHECK_EQ(cached(f[i]), i != 1);
+    }
+    CHECK_EQ(stats.cachemisses, symcache_entries + 1);
+    CHECK_EQ(stats.cachehits, 1);
+    for (int i = 0; i <= symcache_entries; i++)
+    {
+        free(f[i]);
+    }
+}
+
+// entries used in the current round may be on the wire, they stay
+static void test_symcache_round(void)
+{
+    uint8_t *f[RGB7SEG_MAX_DIGITS * 2];
+    char text[16];
+    int n;
+
+    setup(4, 2, "abcdefg");
+    symcache_setup();
+    n = symcache_entries;
+    assert(2 * n + 1 <= sizeof(f) / sizeof(f[0]));
+    for (int i = 0; i <= 2 * n; i++)
+    {
+        snprintf(text, sizeof(text), "%x%x%x%x", i, i, i, i);
+        f[i] = text_frame(text);
+    }
+    for (int i = 0; i < n; i++)
+    {
+        CHECK(symcache_get(f[i]) != NULL);
+    }
+    symcache_round = symcache_clock;
+    for (int i = n; i < 2 * n; i++)
+    {
+        CHECK(symcache_get(f[i]) != NULL);
+    }
+    CHECK(symcache_get(f[2 * n]) == NULL);
+    for (int i = n; i < 2 * n; i++)
+    {
+        CHECK(cached(f[i]));
+    }
+    // a hit is fine, the frame is already on the wire or waiting
+    CHECK(symcache_get(f[n]) != NULL);
+    // next round, the oldest entry goes
+    symcache_round = symcache_clock;
+    CHECK(symcache_get(f[2 * n]) != NULL);
+    CHECK(!cached(f[n + 1]));
+    for (int i = 0; i <= 2 * n; i++)
+    {
+        free(f[i]);
+    }
+}
+
+
+int main(void)
+{
+    RUN(test_blit_masks);
+    RUN(test_glyphs);
+    RUN(test_digit_colors);
+    RUN(test_indicators);
+    RUN(test_high_bytes);
+    RUN(test_text_digits);
+    RUN(test_long_text);
+    RUN(test_marquee_colors);
+    RUN(test_layout_valid);
+    RUN(test_layout_fallback);
+    RUN(test_layout_geometry);
+    RUN(test_wire_order);
+    RUN(test_symcache_hit);
+    RUN(test_symcache_lru);
+    RUN(test_symcache_round);
+    return TEST_RESULT();
+}